@@ -0,0 +1,53 @@
+#include "aligned.h"
+
+#include <atomic>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace aligned {
+namespace {
+std::atomic<bool> hugePagesEnabled(false);
+}
+
+bool hugePages() {
+    return hugePagesEnabled.load(std::memory_order_relaxed);
+}
+
+void setHugePages(bool enabled) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    hugePagesEnabled = enabled;
+#else
+    (void)enabled;
+#endif
+}
+
+void adviseHugePages(void *p, std::size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    madvise(p, bytes / HugePage * HugePage, MADV_HUGEPAGE);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+
+bool lock(void *p, std::size_t bytes) {
+#ifdef __linux__
+    return mlock(p, bytes) == 0;
+#else
+    (void)p;
+    (void)bytes;
+    return false;
+#endif
+}
+
+void unlock(void *p, std::size_t bytes) {
+#ifdef __linux__
+    munlock(p, bytes);
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+}
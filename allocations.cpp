@@ -0,0 +1,75 @@
+#include "allocations.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef NEURO_COUNT_ALLOCATIONS
+#include <new>
+
+namespace {
+thread_local long long allocationCount = 0;
+
+void *allocate(std::size_t size) {
+    allocationCount++;
+    return std::malloc(size ? size : 1);
+}
+}
+
+void *operator new(std::size_t size) {
+    void *p = allocate(size);
+
+    if (!p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+long long allocations::count() {
+    return allocationCount;
+}
+#else
+long long allocations::count() {
+    return -1;
+}
+#endif
+
+NoAllocationScope::NoAllocationScope(const char *name)
+    : name(name), start(allocations::count()) {
+}
+
+NoAllocationScope::~NoAllocationScope() {
+    long long n = allocations::count() - start;
+
+    if (n != 0) {
+        std::fprintf(stderr, "%s: %lld unexpected heap allocation(s)\n", name, n);
+        std::abort();
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Heap allocation counting for debug builds. With NEURO_COUNT_ALLOCATIONS
+// defined, the library replaces the global operator new with a counting one and
+// NEURO_NO_ALLOCATIONS(name) aborts if the rest of the enclosing scope
+// allocates on the calling thread. Without it the macro expands to nothing.
+namespace allocations {
+// Allocations made so far by the calling thread, or -1 when counting is off.
+long long count();
+}
+
+class NoAllocationScope {
+    const char *name;
+    long long start;
+
+public:
+    explicit NoAllocationScope(const char *name);
+    ~NoAllocationScope();
+};
+
+#ifdef NEURO_COUNT_ALLOCATIONS
+#define NEURO_NO_ALLOCATIONS(name) NoAllocationScope noAllocationScope(name)
+#else
+#define NEURO_NO_ALLOCATIONS(name)
+#endif
@@ -0,0 +1,117 @@
+#include "asynctrainer.h"
+
+#include <chrono>
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+template <class T>
+BasicAsyncTrainer<T>::BasicAsyncTrainer(const std::vector<int> &sizes)
+    : net(sizes), stopping(false), publishInterval(10) {
+    net.setVerbose(false);
+}
+
+template <class T>
+BasicAsyncTrainer<T>::~BasicAsyncTrainer() {
+    stop();
+}
+
+template <class T>
+BasicNetwork<T> &BasicAsyncTrainer<T>::network() {
+    return net;
+}
+
+template <class T>
+void BasicAsyncTrainer<T>::start(const BasicDataset<T> &dataset) {
+    stop();
+
+    this->dataset = dataset;
+
+    publish(0, 0, 0);
+
+    stopping = false;
+    thread = std::thread(&BasicAsyncTrainer::run, this);
+}
+
+template <class T>
+void BasicAsyncTrainer<T>::stop() {
+    if (!thread.joinable())
+        return;
+
+    stopping = true;
+    thread.join();
+}
+
+template <class T>
+bool BasicAsyncTrainer<T>::isRunning() const {
+    return thread.joinable();
+}
+
+template <class T>
+std::shared_ptr<const typename BasicAsyncTrainer<T>::Snapshot> BasicAsyncTrainer<T>::snapshot() const {
+    return current.load();
+}
+
+template <class T>
+int BasicAsyncTrainer<T>::getPublishInterval() const {
+    return publishInterval;
+}
+
+template <class T>
+void BasicAsyncTrainer<T>::setPublishInterval(int publishInterval) {
+    this->publishInterval = publishInterval;
+}
+
+template <class T>
+void BasicAsyncTrainer<T>::run() {
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<long long> order(dataset.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::mt19937 random(net.getSeed());
+
+    long long epochs = 0, samples = 0, count = 0;
+    double loss = 0;
+
+    Clock::time_point last = Clock::now();
+
+    while (!stopping && !order.empty()) {
+        if (net.isShuffle())
+            std::shuffle(order.begin(), order.end(), random);
+
+        uint k = 0;
+
+        for (; k < order.size() && !stopping; k++) {
+            loss += net.learn(dataset[order[k]]);
+            count++;
+
+            // Reading the clock every example would cost more than learning
+            // on the tiny networks this is meant for.
+            if (count % 64 == 0 && Clock::now() - last >= std::chrono::milliseconds(publishInterval)) {
+                publish(epochs, samples + count, loss / count);
+
+                samples += count;
+                count = 0;
+                loss = 0;
+                last = Clock::now();
+            }
+        }
+
+        if (k == order.size())
+            epochs++;
+    }
+
+    publish(epochs, samples + count, count > 0 ? loss / count : snapshot()->loss);
+}
+
+template <class T>
+void BasicAsyncTrainer<T>::publish(long long epochs, long long samples, double loss) {
+    std::shared_ptr<const Snapshot> snapshot(new Snapshot{net.freeze(), epochs, samples, loss});
+
+    current.store(snapshot);
+    current.collect();
+}
+
+template class BasicAsyncTrainer<double>;
+template class BasicAsyncTrainer<float>;
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include "network.h"
+#include "publishedptr.h"
+
+// Trains a network on a worker thread, one learn() call per example, epoch
+// after epoch until stopped. Every getPublishInterval() milliseconds the
+// worker publishes an immutable Snapshot of the weights with one atomic pointer
+// swap; readers take the current one with snapshot() without locking, see
+// PublishedPtr, and keep using it for as long as they hold it. Snapshots no
+// reader holds any more are freed by the worker on its next publish.
+template <class T>
+class BasicAsyncTrainer {
+public:
+    struct Snapshot {
+        BasicModel<T> model;
+        long long epochs;
+        long long samples;
+        // Mean loss over the samples since the previous snapshot.
+        double loss;
+    };
+
+private:
+    BasicNetwork<T> net;
+    BasicDataset<T> dataset;
+
+    PublishedPtr<const Snapshot> current;
+
+    std::thread thread;
+    std::atomic<bool> stopping;
+
+    int publishInterval;
+
+public:
+    explicit BasicAsyncTrainer(const std::vector<int> &sizes);
+    ~BasicAsyncTrainer();
+
+    BasicAsyncTrainer(const BasicAsyncTrainer &) = delete;
+    BasicAsyncTrainer &operator=(const BasicAsyncTrainer &) = delete;
+
+    // The trained network; only touch it while the trainer is stopped.
+    BasicNetwork<T> &network();
+
+    // Copies the dataset and starts training; examples are visited in a new
+    // order every epoch if the network shuffles. Publishes a first snapshot
+    // before returning.
+    void start(const BasicDataset<T> &dataset);
+    // Waits for the worker to finish its current example and publishes the
+    // final weights.
+    void stop();
+    bool isRunning() const;
+
+    // Never null once started.
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    int getPublishInterval() const;
+    void setPublishInterval(int publishInterval);
+
+private:
+    void run();
+    void publish(long long epochs, long long samples, double loss);
+};
+
+typedef BasicAsyncTrainer<double> AsyncTrainer;
+typedef BasicAsyncTrainer<float> FloatAsyncTrainer;
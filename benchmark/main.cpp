@@ -0,0 +1,312 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <algorithm>
+
+#include "network.h"
+#include "staticnetwork.h"
+#include "modelregistry.h"
+
+// Prints one JSON object with a result per line, so two runs diff cleanly.
+//
+// benchmark [--quick] [--threads <n>] [--huge-pages] [--baseline <previous output>]
+//
+// With a baseline, every result also gets the ratio of its rate (GFLOP/s or
+// samples/s) to the baseline's; below 1 is a regression.
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+    std::string name;
+    double gflops;
+    double samplesPerSecond;
+    double p50;
+    double p99;
+};
+
+std::vector<Result> results;
+double minSeconds = 0.5;
+
+// Calls f repeatedly for at least minSeconds and records per-call latencies.
+template <class F>
+Result measure(const std::string &name, double flops, const F &f) {
+    std::vector<double> times;
+
+    f();
+
+    Clock::time_point start = Clock::now();
+
+    do {
+        Clock::time_point t0 = Clock::now();
+        f();
+        times.push_back(std::chrono::duration<double>(Clock::now() - t0).count());
+    } while (std::chrono::duration<double>(Clock::now() - start).count() < minSeconds || times.size() < 10);
+
+    std::sort(times.begin(), times.end());
+
+    Result r;
+
+    r.name = name;
+    r.p50 = times[times.size() / 2];
+    r.p99 = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+    r.gflops = flops > 0 ? flops / r.p50 * 1e-9 : 0;
+    r.samplesPerSecond = 1 / r.p50;
+
+    results.push_back(r);
+
+    return r;
+}
+
+std::string shape(int h, int w) {
+    std::ostringstream s;
+    s << h << "x" << w;
+    return s.str();
+}
+
+std::string topology(const std::vector<int> &sizes) {
+    std::ostringstream s;
+
+    for (uint i = 0; i < sizes.size(); i++)
+        s << (i ? "-" : "") << sizes[i];
+
+    return s.str();
+}
+
+template <class T>
+void fillRandom(T *p, int n) {
+    for (int i = 0; i < n; i++)
+        p[i] = (T)rand() / RAND_MAX - 0.5;
+}
+
+void matrixBenchmarks(bool quick) {
+    int shapes[][2] = {{64, 64}, {256, 256}, {785, 512}, {1024, 1024}, {6913, 11}};
+
+    for (auto &s : shapes)
+        for (Matrix<double>::Layout layout : {Matrix<double>::Packed, Matrix<double>::Padded}) {
+            int h = s[0], w = s[1];
+            std::string name = shape(h, w) + (layout == Matrix<double>::Padded ? " padded" : "");
+
+            Matrix<double> m(h, w, layout);
+
+            for (int i = 0; i < h; i++)
+                fillRandom(m[i], w);
+
+            std::vector<double> x(h), y(w);
+            fillRandom(x.data(), h);
+            fillRandom(y.data(), w);
+
+            measure("multiply " + name, 2.0 * h * w, [&]() { m.multiply(x.data(), y.data()); });
+            measure("multiplyTransposed " + name, 2.0 * h * w, [&]() { m.multiplyTransposed(y.data(), x.data()); });
+            measure("addOuterProduct " + name, 2.0 * h * w, [&]() { m.addOuterProduct(x.data(), y.data()); });
+        }
+
+    int sizes[] = {64, 128, 256, 512};
+
+    for (int n : sizes) {
+        if (quick && n > 256)
+            break;
+
+        Matrix<double> a(n, n), b(n, n);
+        fillRandom(a[0], n * n);
+        fillRandom(b[0], n * n);
+
+        measure("multiply " + shape(n, n) + "*" + shape(n, n), 2.0 * n * n * n, [&]() { a.multiply(b); });
+    }
+}
+
+void networkBenchmarks(const std::vector<int> &sizes, int examples, int threads) {
+    std::string name = topology(sizes);
+
+    Network net(sizes);
+    net.setVerbose(false);
+    net.setThreadCount(threads);
+
+    Dataset dataset(sizes[0]);
+    std::vector<std::vector<double>> inputs(std::min(examples, 256), std::vector<double>(sizes[0]));
+
+    for (int i = 0; i < examples; i++) {
+        std::vector<double> &input = inputs[i % inputs.size()];
+
+        fillRandom(input.data(), sizes[0]);
+        dataset.add(input, i % sizes.back());
+    }
+
+    double flops = 0;
+
+    for (uint i = 0; i + 1 < sizes.size(); i++)
+        flops += 2.0 * (sizes[i] + 1) * sizes[i + 1];
+
+    int k = 0;
+
+    Result forward = measure("forward " + name, flops, [&]() { net.forward(inputs[k++ % inputs.size()]); });
+    measure("predict " + name, flops, [&]() { net.predict(dataset.input(k++ % examples)); });
+
+    // backward() is internal. With a large batch the median learn() call only
+    // runs forward, backward and gradient buffering, so the backward time is
+    // the difference to forward.
+    net.setBatchSize(64);
+
+    Result pass = measure("forward+backward " + name, 3 * flops, [&]() { net.learn(dataset[k++ % examples]); });
+
+    Result backward = pass;
+    backward.name = "backward " + name;
+    backward.p50 = std::max(0.0, pass.p50 - forward.p50);
+    backward.p99 = std::max(0.0, pass.p99 - forward.p99);
+    backward.gflops = backward.p50 > 0 ? 2 * flops / backward.p50 * 1e-9 : 0;
+    backward.samplesPerSecond = backward.p50 > 0 ? 1 / backward.p50 : 0;
+    results.push_back(backward);
+
+    net.setBatchSize(1);
+
+    measure("learn " + name, 3 * flops, [&]() { net.learn(dataset[k++ % examples]); });
+
+    net.setBatchSize(16);
+    net.setMaxEpochs(1);
+    net.setMaxLoss(0);
+
+    Result epoch = measure("epoch " + name, 3 * flops * examples, [&]() { net.train(dataset); });
+
+    results.back().samplesPerSecond = examples / epoch.p50;
+}
+
+void staticNetworkBenchmarks() {
+    StaticNetwork<2, 6, 2, 2> net;
+
+    std::vector<double> inputs(2 * 256);
+    fillRandom(inputs.data(), inputs.size());
+
+    double flops = 2.0 * (3 * 6 + 7 * 2 + 3 * 2);
+
+    int k = 0;
+
+    measure("static forward 2-6-2-2", flops, [&]() { net.forward(&inputs[2 * (k++ % 256)]); });
+    measure("static learn 2-6-2-2", 3 * flops, [&]() {
+        int i = k++ % 256;
+        net.learn(&inputs[2 * i], i % 2);
+    });
+}
+
+// current() alone, then with other readers and a thread publishing a new model
+// every millisecond; p99 should stay flat.
+void registryBenchmarks(int threads) {
+    Network net({2, 6, 2, 2});
+
+    ModelRegistry registry;
+    registry.publish(net.freeze());
+
+    measure("registry current", 0, [&]() { registry.current(); });
+
+    std::atomic<bool> done(false);
+    std::vector<std::thread> others;
+
+    int readers = std::max(threads, 2) - 1;
+
+    for (int t = 0; t < readers; t++)
+        others.emplace_back([&]() {
+            while (!done)
+                registry.current();
+        });
+
+    others.emplace_back([&]() {
+        while (!done) {
+            registry.publish(net.freeze());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    measure("registry current " + std::to_string(readers) + " readers reloading", 0, [&]() { registry.current(); });
+
+    done = true;
+
+    for (std::thread &t : others)
+        t.join();
+}
+
+std::map<std::string, double> readBaseline(const std::string &fileName) {
+    std::map<std::string, double> rates;
+
+    std::ifstream file(fileName);
+    std::string line;
+
+    while (std::getline(file, line)) {
+        size_t name = line.find("\"name\": \""), gflops = line.find("\"gflops\": "), samples = line.find("\"samples_per_second\": ");
+
+        if (name == std::string::npos || gflops == std::string::npos || samples == std::string::npos)
+            continue;
+
+        name += 9;
+
+        double g = atof(line.c_str() + gflops + 10), s = atof(line.c_str() + samples + 22);
+
+        rates[line.substr(name, line.find('"', name) - name)] = g > 0 ? g : s;
+    }
+
+    return rates;
+}
+}
+
+int main(int argc, const char **argv) {
+    bool quick = false;
+    int threads = 1;
+    std::string baseline;
+
+    for (int i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "--quick"))
+            quick = true;
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--huge-pages"))
+            aligned::setHugePages(true);
+        else if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+            baseline = argv[++i];
+        else {
+            std::cerr << "usage: benchmark [--quick] [--threads <n>] [--huge-pages] [--baseline <file>]\n";
+            return 1;
+        }
+
+    if (quick)
+        minSeconds = 0.1;
+
+    srand(1);
+
+    matrixBenchmarks(quick);
+
+    networkBenchmarks({2, 6, 2, 2}, quick ? 2000 : 20000, threads);
+    networkBenchmarks({6912, 11}, quick ? 100 : 1000, threads);
+    staticNetworkBenchmarks();
+    registryBenchmarks(threads);
+
+    std::map<std::string, double> rates;
+
+    if (!baseline.empty())
+        rates = readBaseline(baseline);
+
+    std::cout << "{\n";
+    std::cout << "\"isa\": \"" << kernels::isaName(kernels::isa()) << "\",\n";
+    std::cout << "\"threads\": " << threads << ",\n";
+    std::cout << "\"huge_pages\": " << (aligned::hugePages() ? "true" : "false") << ",\n";
+    std::cout << "\"results\": [\n";
+
+    for (uint i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+
+        std::cout << "{\"name\": \"" << r.name << "\", \"gflops\": " << r.gflops << ", \"samples_per_second\": " << r.samplesPerSecond
+                  << ", \"p50_us\": " << r.p50 * 1e6 << ", \"p99_us\": " << r.p99 * 1e6;
+
+        if (rates.count(r.name))
+            std::cout << ", \"baseline_ratio\": " << (r.gflops > 0 ? r.gflops : r.samplesPerSecond) / rates[r.name];
+
+        std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    std::cout << "]\n}\n";
+
+    return 0;
+}
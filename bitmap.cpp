@@ -0,0 +1,124 @@
+#include "bitmap.h"
+
+#include <fstream>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+uint32_t readLittleEndian(const unsigned char *p, int bytes) {
+    uint32_t r = 0;
+
+    for (int i = bytes - 1; i >= 0; i--)
+        r = r << 8 | p[i];
+
+    return r;
+}
+}
+
+Bitmap::Bitmap()
+    : w(0), h(0), pixelSize(3), offset(0), stride(0), bottomUp(false) {
+}
+
+Bitmap::Bitmap(const std::string &fileName)
+    : Bitmap() {
+    read(fileName);
+}
+
+void Bitmap::read(const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+
+    if (!file)
+        throw std::runtime_error("cannot open " + fileName);
+
+    std::streamoff size = file.tellg();
+
+    enum { HeaderSize = 54 };
+
+    if (size < HeaderSize)
+        throw std::runtime_error("not a BMP file: " + fileName);
+
+    data.resize(size);
+
+    file.seekg(0);
+
+    if (!file.read((char *)data.data(), size))
+        throw std::runtime_error("cannot read " + fileName);
+
+    const unsigned char *header = data.data();
+
+    if (header[0] != 'B' || header[1] != 'M')
+        throw std::runtime_error("not a BMP file: " + fileName);
+
+    int32_t width = readLittleEndian(header + 18, 4);
+    int32_t height = readLittleEndian(header + 22, 4);
+    int bits = readLittleEndian(header + 28, 2);
+    uint32_t compression = readLittleEndian(header + 30, 4);
+
+    if ((bits != 24 && bits != 32) || (compression != 0 && compression != 3) || width <= 0 || height == 0)
+        throw std::runtime_error("unsupported BMP file: " + fileName);
+
+    w = width;
+    h = height > 0 ? height : -height;
+    bottomUp = height > 0;
+
+    pixelSize = bits / 8;
+    offset = readLittleEndian(header + 10, 4);
+    stride = ((std::size_t)w * pixelSize + 3) / 4 * 4;
+
+    if (offset + stride * h > data.size())
+        throw std::runtime_error("BMP file is truncated: " + fileName);
+}
+
+int Bitmap::width() const {
+    return w;
+}
+
+int Bitmap::height() const {
+    return h;
+}
+
+void Bitmap::unpack(Layout layout, unsigned char *out) const {
+    std::size_t n = (std::size_t)w * h;
+
+    switch (layout) {
+    case ColumnMajor:
+        for (int x = 0; x < w; x++)
+            for (int y = 0; y < h; y++) {
+                const unsigned char *p = pixel(x, y);
+
+                *out++ = p[2];
+                *out++ = p[1];
+                *out++ = p[0];
+            }
+        break;
+
+    case Interleaved:
+        for (int y = 0; y < h; y++) {
+            const unsigned char *p = pixel(0, y);
+
+            for (int x = 0; x < w; x++, p += pixelSize) {
+                *out++ = p[2];
+                *out++ = p[1];
+                *out++ = p[0];
+            }
+        }
+        break;
+
+    case Planar:
+        for (int y = 0; y < h; y++) {
+            const unsigned char *p = pixel(0, y);
+            unsigned char *r = out + (std::size_t)y * w;
+
+            for (int x = 0; x < w; x++, p += pixelSize) {
+                r[x] = p[2];
+                r[x + n] = p[1];
+                r[x + 2 * n] = p[0];
+            }
+        }
+        break;
+    }
+}
+
+const unsigned char *Bitmap::pixel(int x, int y) const {
+    return data.data() + offset + (std::size_t)(bottomUp ? h - 1 - y : y) * stride + (std::size_t)x * pixelSize;
+}
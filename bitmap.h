@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Uncompressed 24- or 32-bit BMP image. The file is read in one go and pixels
+// are reordered only in unpack(), so one Bitmap can be reused for many files
+// without reallocating.
+class Bitmap {
+    std::vector<unsigned char> data;
+
+    int w, h;
+    int pixelSize;
+    std::size_t offset, stride;
+    bool bottomUp;
+
+public:
+    // Orders of the red, green and blue bytes:
+    // ColumnMajor - pixel by pixel, column by column from the top left;
+    // Interleaved - pixel by pixel, row by row from the top left;
+    // Planar - all red values row by row, then all green, then all blue.
+    enum Layout {
+        ColumnMajor,
+        Interleaved,
+        Planar
+    };
+
+    Bitmap();
+    explicit Bitmap(const std::string &fileName);
+
+    // Throws std::runtime_error if the file cannot be read or is not a
+    // supported BMP.
+    void read(const std::string &fileName);
+
+    int width() const;
+    int height() const;
+
+    // Writes width() * height() * 3 bytes.
+    void unpack(Layout layout, unsigned char *out) const;
+
+private:
+    const unsigned char *pixel(int x, int y) const;
+};
@@ -0,0 +1,377 @@
+#include "dataloader.h"
+#include "aligned.h"
+
+#include <numeric>
+#include <random>
+#include <algorithm>
+
+namespace {
+// Yields before sleeping on an empty or full ring.
+const int SpinCount = 64;
+}
+
+template <class T>
+class BasicDataLoader<T>::Source {
+public:
+    virtual ~Source() {
+    }
+
+    virtual long long size() const = 0;
+    virtual int features() const = 0;
+
+    virtual void read(long long i, T *input, uint &classIndex) const = 0;
+    virtual void release(long long, long long) const {
+    }
+};
+
+template <class T>
+class BasicDataLoader<T>::DatasetSource : public Source {
+    const BasicDataset<T> &dataset;
+
+public:
+    DatasetSource(const BasicDataset<T> &dataset)
+        : dataset(dataset) {
+    }
+
+    long long size() const {
+        return dataset.size();
+    }
+
+    int features() const {
+        return dataset.features();
+    }
+
+    void read(long long i, T *input, uint &classIndex) const {
+        std::copy(dataset.input(i), dataset.input(i) + dataset.features(), input);
+        classIndex = dataset.classIndex(i);
+    }
+};
+
+template <class T>
+class BasicDataLoader<T>::FileSource : public Source {
+    const DatasetFile &file;
+
+public:
+    FileSource(const DatasetFile &file)
+        : file(file) {
+    }
+
+    long long size() const {
+        return file.size();
+    }
+
+    int features() const {
+        return file.features();
+    }
+
+    void read(long long i, T *input, uint &classIndex) const {
+        std::copy(file.input(i), file.input(i) + file.features(), input);
+        classIndex = file.classIndex(i);
+    }
+
+    void release(long long begin, long long end) const {
+        file.release(begin, end);
+    }
+};
+
+template <class T>
+class BasicDataLoader<T>::PointerSource : public Source {
+    std::vector<const T *> inputs;
+    std::vector<uint> classIndices;
+    int featureCount;
+
+public:
+    PointerSource(const std::vector<const T *> &inputs, const std::vector<uint> &classIndices, int features)
+        : inputs(inputs), classIndices(classIndices), featureCount(features) {
+    }
+
+    long long size() const {
+        return inputs.size();
+    }
+
+    int features() const {
+        return featureCount;
+    }
+
+    void read(long long i, T *input, uint &classIndex) const {
+        std::copy(inputs[i], inputs[i] + featureCount, input);
+        classIndex = classIndices[i];
+    }
+};
+
+template <class T>
+BasicDataLoader<T>::BasicDataLoader(const BasicDataset<T> &dataset)
+    : source(new DatasetSource(dataset)), buffer(0), bufferSize(0), locked(false), head(0), tail(0), stopping(false), consumerWaiting(false), producerWaiting(false) {
+    defaults();
+}
+
+template <class T>
+BasicDataLoader<T>::BasicDataLoader(const DatasetFile &file)
+    : source(new FileSource(file)), buffer(0), bufferSize(0), locked(false), head(0), tail(0), stopping(false), consumerWaiting(false), producerWaiting(false) {
+    defaults();
+
+    blockSize = 4096;
+}
+
+template <class T>
+BasicDataLoader<T>::BasicDataLoader(const std::vector<const T *> &inputs, const std::vector<uint> &classIndices, int features)
+    : source(new PointerSource(inputs, classIndices, features)), buffer(0), bufferSize(0), locked(false), head(0), tail(0), stopping(false), consumerWaiting(false), producerWaiting(false) {
+    defaults();
+}
+
+template <class T>
+BasicDataLoader<T>::~BasicDataLoader() {
+    stop();
+}
+
+template <class T>
+void BasicDataLoader<T>::defaults() {
+    batchSize = 64;
+    queueSize = 4;
+    blockSize = 0;
+    shuffle = true;
+    seed = 1;
+}
+
+template <class T>
+long long BasicDataLoader<T>::size() const {
+    return source->size();
+}
+
+template <class T>
+int BasicDataLoader<T>::features() const {
+    return source->features();
+}
+
+template <class T>
+void BasicDataLoader<T>::start(int epochs) {
+    stop();
+
+    std::size_t stride = ((std::size_t)batchSize * features() * sizeof(T) + aligned::Alignment - 1) / aligned::Alignment * aligned::Alignment;
+
+    bufferSize = stride * queueSize;
+    buffer = (char *)aligned::allocate(bufferSize);
+    locked = aligned::lock(buffer, bufferSize);
+
+    slots.resize(queueSize);
+
+    for (int i = 0; i < queueSize; i++) {
+        slots[i].inputs = (T *)(buffer + i * stride);
+        slots[i].classIndices.resize(batchSize);
+    }
+
+    head = 0;
+    tail = 0;
+
+    thread = std::thread(&BasicDataLoader<T>::produce, this, epochs);
+}
+
+template <class T>
+void BasicDataLoader<T>::stop() {
+    if (thread.joinable()) {
+        stopping = true;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+
+        freed.notify_one();
+        thread.join();
+        stopping = false;
+    }
+
+    if (locked)
+        aligned::unlock(buffer, bufferSize);
+
+    aligned::deallocate(buffer);
+
+    buffer = 0;
+    locked = false;
+    slots.clear();
+}
+
+template <class T>
+const typename BasicDataLoader<T>::Batch *BasicDataLoader<T>::next() {
+    long long h = head.load(std::memory_order_relaxed);
+
+    for (int i = 0; tail.load(std::memory_order_acquire) == h; i++) {
+        if (!thread.joinable())
+            return 0;
+
+        if (i < SpinCount) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // The flag is set before the last check of tail and read by the
+        // producer after it moves tail, so one of them sees the other.
+        std::unique_lock<std::mutex> lock(mutex);
+
+        consumerWaiting = true;
+        ready.wait(lock, [this, h]() { return tail != h; });
+        consumerWaiting = false;
+    }
+
+    const Batch *batch = &slots[h % queueSize].batch;
+
+    return batch->count > 0 ? batch : 0;
+}
+
+template <class T>
+void BasicDataLoader<T>::release() {
+    head = head.load(std::memory_order_relaxed) + 1;
+
+    if (producerWaiting) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freed.notify_one();
+    }
+}
+
+template <class T>
+void BasicDataLoader<T>::produce(int epochs) {
+    long long n = size();
+    long long block = blockSize > 0 ? std::min(blockSize, n) : n;
+
+    std::mt19937 random(seed);
+
+    std::vector<long long> order(n), blocks(n > 0 ? (n + block - 1) / block : 0), ends(blocks.size());
+    std::iota(blocks.begin(), blocks.end(), 0);
+
+    long long t = 0;
+
+    // Waits for a free slot; false if the loader is being stopped.
+    auto acquire = [&]() {
+        for (int i = 0; t - head.load(std::memory_order_acquire) >= queueSize; i++) {
+            if (stopping)
+                return false;
+
+            if (i < SpinCount) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+
+            producerWaiting = true;
+            freed.wait(lock, [&]() { return stopping || t - head < queueSize; });
+            producerWaiting = false;
+        }
+
+        return true;
+    };
+
+    auto publish = [&]() {
+        tail = ++t;
+
+        if (consumerWaiting) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.notify_one();
+        }
+    };
+
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        if (shuffle)
+            std::shuffle(blocks.begin(), blocks.end(), random);
+
+        // Rows of one block stay together, so a file is read one block at a time.
+        long long pos = 0;
+
+        for (uint b = 0; b < blocks.size(); b++) {
+            long long begin = blocks[b] * block, end = std::min(begin + block, n);
+
+            std::iota(order.begin() + pos, order.begin() + pos + (end - begin), begin);
+
+            if (shuffle)
+                std::shuffle(order.begin() + pos, order.begin() + pos + (end - begin), random);
+
+            pos += end - begin;
+            ends[b] = pos;
+        }
+
+        uint done = 0;
+
+        for (pos = 0; pos < n; pos += batchSize) {
+            if (!acquire())
+                return;
+
+            Slot &slot = slots[t % queueSize];
+
+            int count = std::min((long long)batchSize, n - pos);
+
+            for (int k = 0; k < count; k++)
+                source->read(order[pos + k], slot.inputs + k * features(), slot.classIndices[k]);
+
+            slot.batch.inputs = slot.inputs;
+            slot.batch.classIndices = slot.classIndices.data();
+            slot.batch.count = count;
+            slot.batch.epoch = epoch;
+            slot.batch.last = pos + count == n;
+
+            publish();
+
+            for (; done < blocks.size() && ends[done] <= pos + count; done++)
+                source->release(blocks[done] * block, std::min((blocks[done] + 1) * block, n));
+        }
+    }
+
+    // An empty batch marks the end.
+    if (!acquire())
+        return;
+
+    slots[t % queueSize].batch.count = 0;
+
+    publish();
+}
+
+template <class T>
+int BasicDataLoader<T>::getBatchSize() const {
+    return batchSize;
+}
+
+template <class T>
+void BasicDataLoader<T>::setBatchSize(int batchSize) {
+    this->batchSize = batchSize;
+}
+
+template <class T>
+int BasicDataLoader<T>::getQueueSize() const {
+    return queueSize;
+}
+
+template <class T>
+void BasicDataLoader<T>::setQueueSize(int queueSize) {
+    this->queueSize = queueSize;
+}
+
+template <class T>
+long long BasicDataLoader<T>::getBlockSize() const {
+    return blockSize;
+}
+
+template <class T>
+void BasicDataLoader<T>::setBlockSize(long long blockSize) {
+    this->blockSize = blockSize;
+}
+
+template <class T>
+bool BasicDataLoader<T>::isShuffle() const {
+    return shuffle;
+}
+
+template <class T>
+void BasicDataLoader<T>::setShuffle(bool shuffle) {
+    this->shuffle = shuffle;
+}
+
+template <class T>
+unsigned BasicDataLoader<T>::getSeed() const {
+    return seed;
+}
+
+template <class T>
+void BasicDataLoader<T>::setSeed(unsigned seed) {
+    this->seed = seed;
+}
+
+template class BasicDataLoader<double>;
+template class BasicDataLoader<float>;
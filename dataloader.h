@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "dataset.h"
+
+// Background loader: a producer thread builds each epoch's permutation and
+// gathers mini-batches into a fixed ring of preallocated, aligned buffers; the
+// consumer takes them with next() and hands them back with release(). The ring
+// is a single-producer single-consumer queue over atomics; a side that finds it
+// empty or full spins briefly, then sleeps until the other side signals. The
+// buffers are one block, locked in memory with aligned::lock() where the OS
+// allows so the producer's gathers never fault; when it does not, for example
+// over RLIMIT_MEMLOCK, they stay pageable and work the same.
+template <class T>
+class BasicDataLoader {
+public:
+    struct Batch {
+        // count rows of features() values each, back to back.
+        const T *inputs;
+        const uint *classIndices;
+        int count;
+
+        int epoch;
+        bool last;
+    };
+
+private:
+    class Source;
+    class DatasetSource;
+    class FileSource;
+    class PointerSource;
+
+    struct Slot {
+        T *inputs;
+        std::vector<uint> classIndices;
+        Batch batch;
+    };
+
+    std::unique_ptr<Source> source;
+
+    std::vector<Slot> slots;
+    char *buffer;
+    std::size_t bufferSize;
+    bool locked;
+    std::atomic<long long> head, tail;
+    std::atomic<bool> stopping;
+
+    // Only touched when a side has to sleep.
+    std::mutex mutex;
+    std::condition_variable ready, freed;
+    std::atomic<bool> consumerWaiting, producerWaiting;
+
+    std::thread thread;
+
+    int batchSize;
+    int queueSize;
+    long long blockSize;
+    bool shuffle;
+    unsigned seed;
+
+public:
+    explicit BasicDataLoader(const BasicDataset<T> &dataset);
+    // Shuffles within blocks of getBlockSize() rows (the block order is shuffled
+    // too) and drops each block's pages once it has been read.
+    explicit BasicDataLoader(const DatasetFile &file);
+    BasicDataLoader(const std::vector<const T *> &inputs, const std::vector<uint> &classIndices, int features);
+    ~BasicDataLoader();
+
+    BasicDataLoader(const BasicDataLoader &) = delete;
+    BasicDataLoader &operator=(const BasicDataLoader &) = delete;
+
+    long long size() const;
+    int features() const;
+
+    // Starts producing batches for the given number of epochs. Settings must
+    // not change while the loader runs.
+    void start(int epochs);
+    void stop();
+
+    // Blocks until the next batch is ready; returns null after the last epoch.
+    // The batch stays valid until release().
+    const Batch *next();
+    void release();
+
+    int getBatchSize() const;
+    void setBatchSize(int batchSize);
+
+    int getQueueSize() const;
+    void setQueueSize(int queueSize);
+
+    long long getBlockSize() const;
+    void setBlockSize(long long blockSize);
+
+    bool isShuffle() const;
+    void setShuffle(bool shuffle);
+
+    unsigned getSeed() const;
+    void setSeed(unsigned seed);
+
+private:
+    void defaults();
+    void produce(int epochs);
+};
+
+typedef BasicDataLoader<double> DataLoader;
+typedef BasicDataLoader<float> FloatDataLoader;
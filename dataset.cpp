@@ -0,0 +1,170 @@
+#include "dataset.h"
+#include "aligned.h"
+
+#include <algorithm>
+
+template <class T>
+ExampleView<T>::ExampleView(const T *input, int size, uint classIndex)
+    : in(input), n(size), ci(classIndex) {
+}
+
+template <class T>
+const T *ExampleView<T>::input() const {
+    return in;
+}
+
+template <class T>
+int ExampleView<T>::size() const {
+    return n;
+}
+
+template <class T>
+uint ExampleView<T>::classIndex() const {
+    return ci;
+}
+
+template <class T>
+BasicDataset<T>::BasicDataset(int features)
+    : x(0), featureCount(features), capacity(0) {
+}
+
+template <class T>
+BasicDataset<T>::BasicDataset(const DatasetFile &file)
+    : x(0), featureCount(file.features()), capacity(0) {
+    reserve(file.size());
+
+    for (long long i = 0; i < file.size(); i++) {
+        std::copy(file.input(i), file.input(i) + featureCount, x + i * featureCount);
+        labels.push_back(file.classIndex(i));
+    }
+}
+
+template <class T>
+BasicDataset<T>::BasicDataset(const BasicDataset<T> &dataset)
+    : x(0), featureCount(0), capacity(0) {
+    *this = dataset;
+}
+
+template <class T>
+BasicDataset<T>::BasicDataset(BasicDataset<T> &&dataset)
+    : x(0), featureCount(0), capacity(0) {
+    *this = std::move(dataset);
+}
+
+template <class T>
+BasicDataset<T>::~BasicDataset() {
+    aligned::deallocate(x);
+}
+
+template <class T>
+BasicDataset<T> &BasicDataset<T>::operator=(const BasicDataset<T> &dataset) {
+    if (this == &dataset)
+        return *this;
+
+    aligned::deallocate(x);
+
+    x = 0;
+    capacity = 0;
+    featureCount = dataset.featureCount;
+    labels.clear();
+
+    reserve(dataset.size());
+
+    std::copy(dataset.x, dataset.x + dataset.size() * featureCount, x);
+    labels = dataset.labels;
+
+    return *this;
+}
+
+template <class T>
+BasicDataset<T> &BasicDataset<T>::operator=(BasicDataset<T> &&dataset) {
+    std::swap(x, dataset.x);
+    std::swap(labels, dataset.labels);
+    std::swap(featureCount, dataset.featureCount);
+    std::swap(capacity, dataset.capacity);
+
+    return *this;
+}
+
+template <class T>
+long long BasicDataset<T>::size() const {
+    return labels.size();
+}
+
+template <class T>
+int BasicDataset<T>::features() const {
+    return featureCount;
+}
+
+template <class T>
+const T *BasicDataset<T>::input(long long i) const {
+    return x + i * featureCount;
+}
+
+template <class T>
+uint BasicDataset<T>::classIndex(long long i) const {
+    return labels[i];
+}
+
+template <class T>
+T *BasicDataset<T>::input(long long i) {
+    return x + i * featureCount;
+}
+
+template <class T>
+void BasicDataset<T>::setClassIndex(long long i, uint classIndex) {
+    labels[i] = classIndex;
+}
+
+template <class T>
+ExampleView<T> BasicDataset<T>::operator[](long long i) const {
+    return ExampleView<T>(input(i), featureCount, labels[i]);
+}
+
+template <class T>
+void BasicDataset<T>::reserve(long long size) {
+    if (size <= capacity)
+        return;
+
+    T *p = (T *)aligned::allocate(size * featureCount * sizeof(T));
+
+    std::copy(x, x + this->size() * featureCount, p);
+
+    aligned::deallocate(x);
+
+    x = p;
+    capacity = size;
+
+    labels.reserve(size);
+}
+
+template <class T>
+void BasicDataset<T>::resize(long long size) {
+    reserve(size);
+    labels.resize(size);
+}
+
+template <class T>
+void BasicDataset<T>::clear() {
+    labels.clear();
+}
+
+template <class T>
+void BasicDataset<T>::add(const T *input, uint classIndex) {
+    if (size() == capacity)
+        reserve(std::max(16LL, capacity * 2));
+
+    std::copy(input, input + featureCount, x + size() * featureCount);
+    labels.push_back(classIndex);
+}
+
+template <class T>
+void BasicDataset<T>::add(const std::vector<T> &input, uint classIndex) {
+    add(input.data(), classIndex);
+}
+
+template class ExampleView<double>;
+template class ExampleView<float>;
+
+template class BasicDataset<double>;
+template class BasicDataset<float>;
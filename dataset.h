@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "datasetfile.h"
+
+// Non-owning example: the input must outlive the view.
+template <class T>
+class ExampleView {
+    const T *in;
+    int n;
+    uint ci;
+
+public:
+    ExampleView(const T *input, int size, uint classIndex);
+
+    const T *input() const;
+    int size() const;
+    uint classIndex() const;
+};
+
+// In-memory dataset with every feature vector in one contiguous, 64-byte
+// aligned buffer, row after row.
+template <class T>
+class BasicDataset {
+    T *x;
+    std::vector<uint> labels;
+
+    int featureCount;
+    long long capacity;
+
+public:
+    explicit BasicDataset(int features = 0);
+    // Reads the whole file into memory, converting the features to T.
+    explicit BasicDataset(const DatasetFile &file);
+
+    BasicDataset(const BasicDataset &dataset);
+    BasicDataset(BasicDataset &&dataset);
+    ~BasicDataset();
+
+    BasicDataset &operator=(const BasicDataset &dataset);
+    BasicDataset &operator=(BasicDataset &&dataset);
+
+    long long size() const;
+    int features() const;
+
+    const T *input(long long i) const;
+    uint classIndex(long long i) const;
+
+    // For filling rows in place, e.g. from several threads after resize().
+    T *input(long long i);
+    void setClassIndex(long long i, uint classIndex);
+
+    ExampleView<T> operator[](long long i) const;
+
+    void reserve(long long size);
+    // New rows are left uninitialized, with class 0.
+    void resize(long long size);
+    void clear();
+
+    void add(const T *input, uint classIndex);
+    void add(const std::vector<T> &input, uint classIndex);
+};
+
+typedef BasicDataset<double> Dataset;
+typedef BasicDataset<float> FloatDataset;
@@ -0,0 +1,247 @@
+#include "datasetfile.h"
+#include "mappedfile.h"
+#include "fileformat.h"
+#include "bitmap.h"
+#include "kernels.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace fileformat;
+
+namespace {
+const char Magic[8] = {'N', 'E', 'U', 'R', 'O', 'D', 'A', 'T'};
+
+enum {
+    Version = 1
+};
+
+struct DatasetHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t size;
+    uint32_t features;
+    uint32_t classes;
+    uint64_t labelOffset;
+    uint64_t tag;
+    char reserved[16];
+};
+
+uint32_t readBigEndian(std::istream &stream) {
+    unsigned char b[4] = {};
+    stream.read((char *)b, 4);
+
+    return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+}
+
+// Reads a BMP into the column-major RGB layout described in
+// DatasetFile::importBmp().
+void readBmp(const std::string &fileName, Bitmap &bitmap, std::vector<unsigned char> &pixels, std::vector<float> &features) {
+    bitmap.read(fileName);
+
+    pixels.resize((size_t)bitmap.width() * bitmap.height() * 3);
+    features.resize(pixels.size());
+
+    bitmap.unpack(Bitmap::ColumnMajor, pixels.data());
+    kernels::bytesToFloat(pixels.size(), pixels.data(), 255.0f, features.data());
+}
+}
+
+DatasetFile::DatasetFile(const std::string &fileName)
+    : mapping(std::make_shared<MappedFile>(fileName)) {
+    const char *data = mapping->data();
+    std::size_t size = mapping->size();
+
+    DatasetHeader header;
+
+    if (size < sizeof(header))
+        throw std::runtime_error("dataset file is truncated");
+
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        throw std::runtime_error("not a dataset file: " + fileName);
+
+    if (header.byteOrder != ByteOrder)
+        throw std::runtime_error("dataset file has a different byte order");
+
+    if (header.version != Version)
+        throw std::runtime_error("unsupported dataset file version");
+
+    uint64_t features = header.size * header.features * sizeof(float);
+
+    if (header.labelOffset < sizeof(header) + features || header.labelOffset % Alignment != 0 || header.labelOffset + header.size * sizeof(uint32_t) > size)
+        throw std::runtime_error("dataset file is truncated");
+
+    x = (const float *)(data + sizeof(header));
+    labels = (const uint32_t *)(data + header.labelOffset);
+
+    count = header.size;
+    featureCount = header.features;
+    classCount = header.classes;
+    userTag = header.tag;
+}
+
+long long DatasetFile::size() const {
+    return count;
+}
+
+int DatasetFile::features() const {
+    return featureCount;
+}
+
+int DatasetFile::classes() const {
+    return classCount;
+}
+
+const float *DatasetFile::input(long long i) const {
+    return x + i * featureCount;
+}
+
+uint DatasetFile::classIndex(long long i) const {
+    return labels[i];
+}
+
+uint64_t DatasetFile::tag() const {
+    return userTag;
+}
+
+void DatasetFile::release(long long begin, long long end) const {
+    const char *base = mapping->data();
+
+    mapping->discard((const char *)input(begin) - base, (end - begin) * featureCount * sizeof(float));
+}
+
+void DatasetFile::importIdx(const std::string &imagesFileName, const std::string &labelsFileName, const std::string &fileName) {
+    std::ifstream images(imagesFileName, std::ios::binary), labels(labelsFileName, std::ios::binary);
+
+    if (!images || !labels)
+        throw std::runtime_error("cannot open " + (images ? labelsFileName : imagesFileName));
+
+    uint32_t imageMagic = readBigEndian(images), labelMagic = readBigEndian(labels);
+
+    // 0x08 is the unsigned byte type; the low byte is the number of dimensions.
+    if ((imageMagic & 0xffffff00) != 0x0800 || (imageMagic & 0xff) < 1 || labelMagic != 0x0801)
+        throw std::runtime_error("unsupported IDX file");
+
+    uint32_t count = readBigEndian(images), labelCount = readBigEndian(labels);
+
+    if (count != labelCount)
+        throw std::runtime_error("IDX image and label counts differ");
+
+    int features = 1;
+
+    for (uint32_t i = 1; i < (imageMagic & 0xff); i++)
+        features *= readBigEndian(images);
+
+    DatasetWriter writer(fileName, features);
+
+    std::vector<unsigned char> pixels(features);
+    std::vector<float> input(features);
+
+    for (uint32_t i = 0; i < count; i++) {
+        unsigned char label;
+
+        if (!images.read((char *)pixels.data(), features) || !labels.read((char *)&label, 1))
+            throw std::runtime_error("IDX file is truncated");
+
+        for (int j = 0; j < features; j++)
+            input[j] = pixels[j] / 255.0f;
+
+        writer.add(input.data(), label);
+    }
+
+    writer.close();
+}
+
+void DatasetFile::importBmp(const std::vector<std::pair<std::string, uint>> &images, const std::string &fileName) {
+    std::unique_ptr<DatasetWriter> writer;
+
+    int width = 0, height = 0;
+
+    Bitmap bitmap;
+    std::vector<unsigned char> pixels;
+    std::vector<float> input;
+
+    for (const std::pair<std::string, uint> &image : images) {
+        readBmp(image.first, bitmap, pixels, input);
+
+        if (!writer) {
+            width = bitmap.width();
+            height = bitmap.height();
+
+            writer.reset(new DatasetWriter(fileName, input.size()));
+        } else if (bitmap.width() != width || bitmap.height() != height)
+            throw std::runtime_error("BMP size differs from the first image: " + image.first);
+
+        writer->add(input.data(), image.second);
+    }
+
+    if (!writer)
+        writer.reset(new DatasetWriter(fileName, 0));
+
+    writer->close();
+}
+
+DatasetWriter::DatasetWriter(const std::string &fileName, int features)
+    : file(fileName, std::ios::binary), fileName(fileName), featureCount(features), classCount(0), userTag(0) {
+    if (!file)
+        throw std::runtime_error("cannot write " + fileName);
+
+    char header[sizeof(DatasetHeader)] = {};
+    file.write(header, sizeof(header));
+}
+
+DatasetWriter::~DatasetWriter() {
+    if (file.is_open())
+        try {
+            close();
+        } catch (...) {
+        }
+}
+
+void DatasetWriter::setTag(uint64_t tag) {
+    userTag = tag;
+}
+
+void DatasetWriter::add(const float *input, uint classIndex) {
+    file.write((const char *)input, featureCount * sizeof(float));
+
+    labels.push_back(classIndex);
+    classCount = std::max(classCount, classIndex + 1);
+}
+
+void DatasetWriter::close() {
+    uint64_t end = sizeof(DatasetHeader) + (uint64_t)labels.size() * featureCount * sizeof(float);
+    uint64_t labelOffset = align(end);
+
+    char padding[Alignment] = {};
+    file.write(padding, labelOffset - end);
+
+    if (!labels.empty())
+        file.write((const char *)labels.data(), labels.size() * sizeof(uint32_t));
+
+    DatasetHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+
+    header.version = Version;
+    header.byteOrder = ByteOrder;
+    header.size = labels.size();
+    header.features = featureCount;
+    header.classes = classCount;
+    header.labelOffset = labelOffset;
+    header.tag = userTag;
+
+    file.seekp(0);
+    file.write((const char *)&header, sizeof(header));
+
+    bool ok = (bool)file;
+
+    file.close();
+
+    if (!ok)
+        throw std::runtime_error("cannot write " + fileName);
+}
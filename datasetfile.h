@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <utility>
+#include <cstdint>
+
+class MappedFile;
+
+typedef unsigned int uint;
+
+// Memory-mapped dataset file: a 64-byte header, a block of size() rows of
+// features() float32 values each, and a block of uint32 class indices. Rows
+// are only paged in when read, so datasets may be larger than RAM.
+class DatasetFile {
+    std::shared_ptr<const MappedFile> mapping;
+
+    const float *x;
+    const uint32_t *labels;
+
+    long long count;
+    int featureCount;
+    int classCount;
+    uint64_t userTag;
+
+public:
+    // Throws std::runtime_error on a damaged or unsupported file.
+    explicit DatasetFile(const std::string &fileName);
+
+    long long size() const;
+    int features() const;
+    int classes() const;
+
+    const float *input(long long i) const;
+    uint classIndex(long long i) const;
+
+    // See DatasetWriter::setTag(); 0 in files written without one.
+    uint64_t tag() const;
+
+    // Tells the OS that rows [begin, end) will not be read again soon, so their
+    // pages can be dropped rather than kept resident.
+    void release(long long begin, long long end) const;
+
+    // Converts IDX (MNIST) image and label files; pixels are scaled to [0, 1].
+    static void importIdx(const std::string &imagesFileName, const std::string &labelsFileName, const std::string &fileName);
+    // Converts uncompressed 24- or 32-bit BMP images of equal size. Features are
+    // red, green and blue scaled to [0, 1], column by column from the top left.
+    static void importBmp(const std::vector<std::pair<std::string, uint>> &images, const std::string &fileName);
+};
+
+// Writes a dataset file one example at a time; only the class indices are
+// kept in memory until close().
+class DatasetWriter {
+    std::ofstream file;
+    std::string fileName;
+
+    std::vector<uint32_t> labels;
+
+    int featureCount;
+    uint classCount;
+    uint64_t userTag;
+
+public:
+    DatasetWriter(const std::string &fileName, int features);
+    ~DatasetWriter();
+
+    // Stores a value of the caller's choosing in the header, e.g. a hash of
+    // the sources the file was built from, to tell whether it is out of date.
+    void setTag(uint64_t tag);
+
+    void add(const float *input, uint classIndex);
+
+    // Writes the class indices and the header. Throws std::runtime_error if
+    // the file could not be written.
+    void close();
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// Shared by the binary file formats: files are written in host byte order with
+// a mark that detects a mismatch, and data blocks start on cache lines.
+namespace fileformat {
+enum {
+    ByteOrder = 0x01020304,
+    Alignment = 64
+};
+
+inline uint64_t align(uint64_t n) {
+    return (n + Alignment - 1) / Alignment * Alignment;
+}
+
+// FNV-1a over 64-bit words; size is a multiple of 8. Pass the checksum of
+// the preceding bytes as h to continue it over the next block.
+inline uint64_t checksum(const char *data, std::size_t size, uint64_t h = 14695981039346656037ULL) {
+    for (std::size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+
+        h = (h ^ word) * 1099511628211ULL;
+    }
+
+    return h;
+}
+}
@@ -4,14 +4,15 @@
 #include <ctime>
 #include <cmath>
 
-MainWindow::MainWindow() {
+MainWindow::MainWindow()
+    : trainer(0), pool(new ThreadPool(ThreadPool::hardwareConcurrency())) {
     srand(time(0));
 
     resize(Application::desktop()->size() / 1.5);
     setMinimumSize(Application::desktop()->size() / 4);
     move(Application::desktop()->rect().center() - rect().center());
 
-    createNet();
+    createTrainer();
     init();
     defaults();
 
@@ -19,7 +20,8 @@ MainWindow::MainWindow() {
 }
 
 MainWindow::~MainWindow() {
-    delete net;
+    delete trainer;
+    delete pool;
 }
 
 void MainWindow::closeEvent() {
@@ -27,7 +29,7 @@ void MainWindow::closeEvent() {
 }
 
 void MainWindow::timerEvent(TimerEvent *) {
-    learn();
+    std::cout << trainer->snapshot()->loss << "\n" << std::flush;
     update();
 }
 
@@ -69,12 +71,18 @@ void MainWindow::paintEvent() {
 
     int radius = 5;
 
-    double step = 0.1;
+    double step = 0.05;
 
-    for (double x = -5; x < 5; x += step)
-        for (double y = -5; y < 5; y += step) {
-            uint out = net->predict({x, y});
-            p.fillRect(fr::Rectangle((x - 0.5) * scale + width() / 2, (0.5 - y - step) * scale + height() / 2, (x - 0.5 + step) * scale + width() / 2, (0.5 - y) * scale + height() / 2), out == 0 ? bgRed : bgGreen);
+    Grid<double> grid = {-5, -5, step, step, 200, 200};
+    classes.resize(grid.columns * grid.rows);
+
+    std::shared_ptr<const AsyncTrainer::Snapshot> snapshot = trainer->snapshot();
+    snapshot->model.predictGrid(grid, classes.data(), pool);
+
+    for (int j = 0; j < grid.rows; j++)
+        for (int i = 0; i < grid.columns; i++) {
+            double x = grid.x0 + i * step, y = grid.y0 + j * step;
+            p.fillRect(fr::Rectangle((x - 0.5) * scale + width() / 2, (0.5 - y - step) * scale + height() / 2, (x - 0.5 + step) * scale + width() / 2, (0.5 - y) * scale + height() / 2), classes[j * grid.columns + i] == 0 ? bgRed : bgGreen);
         }
 
     for (const std::pair<Vector2, int> &point : points) {
@@ -85,35 +93,31 @@ void MainWindow::paintEvent() {
     }
 }
 
-void MainWindow::createNet() {
-    net = new Network({2, 6, 2, 2});
-    net->setVerbose(false);
-
-    net->setLearningRate(0.01);
-    net->setMomentum(0.1);
-    net->setL2Decay(0.001);
-
-    net->setBatchSize(10);
-}
-
-void MainWindow::learn() {
-    const int n = 20;
+void MainWindow::createTrainer() {
+    trainer = new AsyncTrainer({2, 6, 2, 2});
 
-    double averageLoss = 0;
+    Network &net = trainer->network();
 
-    for (int i = 0; i < n; i++)
-        for (const std::pair<Vector2, int> &point : points)
-            averageLoss += net->learn(Network::Example({point.first.x(), point.first.y()}, point.second));
+    net.setLearningRate(0.01);
+    net.setMomentum(0.1);
+    net.setL2Decay(0.001);
 
-    averageLoss /= n * points.size();
-
-    std::cout << averageLoss << "\n" << std::flush;
+    net.setBatchSize(10);
 }
 
 void MainWindow::init() {
+    trainer->stop();
+
     points.clear();
     defaultData();
-    net->init();
+
+    Dataset dataset(2);
+
+    for (const std::pair<Vector2, int> &point : points)
+        dataset.add({point.first.x(), point.first.y()}, point.second);
+
+    trainer->network().init();
+    trainer->start(dataset);
 }
 
 void MainWindow::defaultData() {
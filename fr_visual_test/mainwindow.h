@@ -1,11 +1,13 @@
 #pragma once
 
 #include "fr.h"
-#include "network.h"
+#include "asynctrainer.h"
 
 class MainWindow : public Window {
-    Network *net;
+    AsyncTrainer *trainer;
+    ThreadPool *pool;
     std::vector<std::pair<Vector2, int>> points;
+    std::vector<uint> classes;
 
     double scale;
 
@@ -21,8 +23,7 @@ protected:
     void paintEvent();
 
 private:
-    void createNet();
-    void learn();
+    void createTrainer();
     void init();
     void defaultData();
     void circleData();
@@ -0,0 +1,240 @@
+#include "imageloader.h"
+#include "threadpool.h"
+#include "kernels.h"
+
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+void toFeatures(int n, const unsigned char *pixels, float *out, std::vector<float> &) {
+    kernels::bytesToFloat(n, pixels, 255.0f, out);
+}
+
+// Rounds like the float path, so both types hold the same values.
+void toFeatures(int n, const unsigned char *pixels, double *out, std::vector<float> &buffer) {
+    buffer.resize(n);
+    kernels::bytesToFloat(n, pixels, 255.0f, buffer.data());
+
+    std::copy(buffer.begin(), buffer.end(), out);
+}
+
+const float *toFloat(int, const float *input, std::vector<float> &) {
+    return input;
+}
+
+const float *toFloat(int n, const double *input, std::vector<float> &buffer) {
+    buffer.assign(input, input + n);
+    return buffer.data();
+}
+
+bool isBmp(const std::string &name) {
+    if (name.size() < 4)
+        return false;
+
+    std::string extension = name.substr(name.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    return extension == ".bmp";
+}
+
+// FNV-1a.
+struct Hash {
+    uint64_t h;
+
+    Hash()
+        : h(14695981039346656037ULL) {
+    }
+
+    void add(const void *data, std::size_t size) {
+        for (std::size_t i = 0; i < size; i++) {
+            h ^= ((const unsigned char *)data)[i];
+            h *= 1099511628211ULL;
+        }
+    }
+
+    void add(int64_t v) {
+        add(&v, sizeof(v));
+    }
+};
+}
+
+template <class T>
+BasicImageLoader<T>::BasicImageLoader()
+    : layout(Bitmap::ColumnMajor) {
+}
+
+template <class T>
+std::vector<std::pair<std::string, uint>> BasicImageLoader<T>::listFolders(const std::vector<std::string> &folders) {
+    std::vector<std::pair<std::string, uint>> images;
+
+    for (uint i = 0; i < folders.size(); i++) {
+        DIR *dir = opendir(folders[i].c_str());
+
+        if (!dir)
+            throw std::runtime_error("cannot read " + folders[i]);
+
+        std::vector<std::string> names;
+
+        while (dirent *entry = readdir(dir))
+            if (isBmp(entry->d_name))
+                names.push_back(entry->d_name);
+
+        closedir(dir);
+
+        std::sort(names.begin(), names.end());
+
+        for (const std::string &name : names)
+            images.push_back(std::make_pair(folders[i] + "/" + name, i));
+    }
+
+    return images;
+}
+
+template <class T>
+BasicDataset<T> BasicImageLoader<T>::load(const std::vector<std::pair<std::string, uint>> &images, ThreadPool *pool) const {
+    if (cacheFileName.empty())
+        return decode(images, pool);
+
+    uint64_t tag = hash(images);
+
+    // A cache that is missing, damaged or stale is simply rebuilt.
+    try {
+        DatasetFile file(cacheFileName);
+
+        if (file.tag() == tag && file.size() == (long long)images.size())
+            return BasicDataset<T>(file);
+    } catch (const std::runtime_error &) {
+    }
+
+    BasicDataset<T> dataset = decode(images, pool);
+    writeCache(dataset, tag);
+
+    return dataset;
+}
+
+template <class T>
+BasicDataset<T> BasicImageLoader<T>::loadFolders(const std::vector<std::string> &folders, ThreadPool *pool) const {
+    return load(listFolders(folders), pool);
+}
+
+template <class T>
+Bitmap::Layout BasicImageLoader<T>::getLayout() const {
+    return layout;
+}
+
+template <class T>
+void BasicImageLoader<T>::setLayout(Bitmap::Layout layout) {
+    this->layout = layout;
+}
+
+template <class T>
+const std::string &BasicImageLoader<T>::getCacheFile() const {
+    return cacheFileName;
+}
+
+template <class T>
+void BasicImageLoader<T>::setCacheFile(const std::string &fileName) {
+    cacheFileName = fileName;
+}
+
+template <class T>
+BasicDataset<T> BasicImageLoader<T>::decode(const std::vector<std::pair<std::string, uint>> &images, ThreadPool *pool) const {
+    if (images.empty())
+        return BasicDataset<T>();
+
+    // The first image sets the row size, so it is decoded before the others.
+    Bitmap first(images[0].first);
+
+    int width = first.width(), height = first.height();
+    int features = width * height * 3;
+
+    BasicDataset<T> dataset(features);
+    dataset.resize(images.size());
+
+    long long count = images.size();
+    std::atomic<long long> next(0);
+
+    int n = pool ? pool->size() : 1;
+    std::vector<std::exception_ptr> errors(n);
+
+    auto work = [&](int t) {
+        Bitmap bitmap;
+        std::vector<unsigned char> pixels(features);
+        std::vector<float> buffer;
+
+        try {
+            for (long long i; (i = next++) < count;) {
+                const Bitmap *image = &first;
+
+                if (i > 0) {
+                    bitmap.read(images[i].first);
+
+                    if (bitmap.width() != width || bitmap.height() != height)
+                        throw std::runtime_error("BMP size differs from the first image: " + images[i].first);
+
+                    image = &bitmap;
+                }
+
+                image->unpack(layout, pixels.data());
+                toFeatures(features, pixels.data(), dataset.input(i), buffer);
+
+                dataset.setClassIndex(i, images[i].second);
+            }
+        } catch (...) {
+            errors[t] = std::current_exception();
+            next = count;
+        }
+    };
+
+    if (pool)
+        pool->run(work);
+    else
+        work(0);
+
+    for (const std::exception_ptr &error : errors)
+        if (error)
+            std::rethrow_exception(error);
+
+    return dataset;
+}
+
+template <class T>
+void BasicImageLoader<T>::writeCache(const BasicDataset<T> &dataset, uint64_t tag) const {
+    DatasetWriter writer(cacheFileName, dataset.features());
+    writer.setTag(tag);
+
+    std::vector<float> buffer;
+
+    for (long long i = 0; i < dataset.size(); i++)
+        writer.add(toFloat(dataset.features(), dataset.input(i), buffer), dataset.classIndex(i));
+
+    writer.close();
+}
+
+template <class T>
+uint64_t BasicImageLoader<T>::hash(const std::vector<std::pair<std::string, uint>> &images) const {
+    Hash h;
+    h.add(layout);
+
+    for (const std::pair<std::string, uint> &image : images) {
+        struct stat s;
+
+        bool found = stat(image.first.c_str(), &s) == 0;
+
+        h.add(image.first.data(), image.first.size() + 1);
+        h.add(image.second);
+        h.add(found ? (int64_t)s.st_size : -1);
+        h.add(found ? (int64_t)s.st_mtime : -1);
+    }
+
+    return h.h;
+}
+
+template class BasicImageLoader<double>;
+template class BasicImageLoader<float>;
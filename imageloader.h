@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+
+#include "dataset.h"
+#include "bitmap.h"
+
+class ThreadPool;
+
+// Turns BMP images into a dataset, one row of width * height * 3 features per
+// image with red, green and blue scaled to [0, 1] in the chosen layout. Images
+// are decoded on the pool's threads straight into the dataset's buffer, and the
+// bytes are converted to floating point with the vectorized kernels.
+//
+// With a cache file set, the converted dataset is also written there, tagged
+// with a hash of the layout and of the path, class, size and modification time
+// of every image; a later load() of the same images reads the cache instead of
+// decoding anything.
+template <class T>
+class BasicImageLoader {
+    Bitmap::Layout layout;
+    std::string cacheFileName;
+
+public:
+    BasicImageLoader();
+
+    // Lists the BMP files of each folder, sorted by name; files in folders[i]
+    // get class i. Throws std::runtime_error if a folder cannot be read.
+    static std::vector<std::pair<std::string, uint>> listFolders(const std::vector<std::string> &folders);
+
+    // Throws std::runtime_error if an image cannot be read or differs in size
+    // from the first one.
+    BasicDataset<T> load(const std::vector<std::pair<std::string, uint>> &images, ThreadPool *pool = 0) const;
+    BasicDataset<T> loadFolders(const std::vector<std::string> &folders, ThreadPool *pool = 0) const;
+
+    // Bitmap::ColumnMajor by default, the layout of DatasetFile::importBmp().
+    Bitmap::Layout getLayout() const;
+    void setLayout(Bitmap::Layout layout);
+
+    // Empty by default, for no cache.
+    const std::string &getCacheFile() const;
+    void setCacheFile(const std::string &fileName);
+
+private:
+    BasicDataset<T> decode(const std::vector<std::pair<std::string, uint>> &images, ThreadPool *pool) const;
+    void writeCache(const BasicDataset<T> &dataset, uint64_t tag) const;
+
+    uint64_t hash(const std::vector<std::pair<std::string, uint>> &images) const;
+};
+
+typedef BasicImageLoader<double> ImageLoader;
+typedef BasicImageLoader<float> FloatImageLoader;
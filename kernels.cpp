@@ -0,0 +1,534 @@
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NEURO_X86
+#include <immintrin.h>
+#endif
+
+namespace kernels {
+
+Table<double> doubleTable = {
+    &axpy<double>,
+    &axpy4<double>,
+    &dot<double>,
+    &dot4<double>,
+    &tile<double>,
+    &add<double>,
+    &mul<double>,
+    &div<double>,
+    &max<double>,
+    &momentum<double>,
+    &nesterov<double>,
+    &adam<double>,
+    &rmsprop<double>,
+    &fastTanh<double>,
+    &fastExp<double>
+};
+
+Table<float> floatTable = {
+    &axpy<float>,
+    &axpy4<float>,
+    &dot<float>,
+    &dot4<float>,
+    &tile<float>,
+    &add<float>,
+    &mul<float>,
+    &div<float>,
+    &max<float>,
+    &momentum<float>,
+    &nesterov<float>,
+    &adam<float>,
+    &rmsprop<float>,
+    &fastTanh<float>,
+    &fastExp<float>
+};
+
+IntegerTable integerTable = {
+    &dot8<int8_t>,
+    &dot8x4<int8_t>,
+    &bytesToFloat<uint8_t>
+};
+
+#ifdef NEURO_X86
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+namespace sse2 {
+struct Double {
+    typedef double Scalar;
+    typedef __m128d Vector;
+
+    enum { Size = 2 };
+
+    static Vector zero() { return _mm_setzero_pd(); }
+    static Vector set(double x) { return _mm_set1_pd(x); }
+    static Vector load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, Vector v) { _mm_storeu_pd(p, v); }
+    static Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm_div_pd(a, b); }
+    static Vector sqrt(Vector a) { return _mm_sqrt_pd(a); }
+    static Vector max(Vector a, Vector b) { return _mm_max_pd(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm_min_pd(a, b); }
+    static Vector madd(Vector a, Vector b, Vector c) { return _mm_add_pd(c, _mm_mul_pd(a, b)); }
+    static double madd(double a, double b, double c) { return c + a * b; }
+
+    // 2^k for integral k in the normal exponent range: adding 2^52 + 1023
+    // leaves the biased exponent in the low mantissa bits.
+    static Vector pow2(Vector k) {
+        return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(_mm_add_pd(k, set(4503599627370496.0 + 1023))), 52));
+    }
+
+    static double sum(Vector v) {
+        return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+    }
+
+    static double max(Vector v) {
+        return _mm_cvtsd_f64(_mm_max_sd(v, _mm_unpackhi_pd(v, v)));
+    }
+};
+
+struct Float {
+    typedef float Scalar;
+    typedef __m128 Vector;
+
+    enum { Size = 4 };
+
+    static Vector zero() { return _mm_setzero_ps(); }
+    static Vector set(float x) { return _mm_set1_ps(x); }
+    static Vector load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, Vector v) { _mm_storeu_ps(p, v); }
+    static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm_div_ps(a, b); }
+    static Vector sqrt(Vector a) { return _mm_sqrt_ps(a); }
+    static Vector max(Vector a, Vector b) { return _mm_max_ps(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm_min_ps(a, b); }
+    static Vector madd(Vector a, Vector b, Vector c) { return _mm_add_ps(c, _mm_mul_ps(a, b)); }
+    static float madd(float a, float b, float c) { return c + a * b; }
+
+    static Vector pow2(Vector k) {
+        return _mm_castsi128_ps(_mm_slli_epi32(_mm_castps_si128(_mm_add_ps(k, set(8388608.0f + 127))), 23));
+    }
+
+    static float sum(Vector v) {
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_add_ss(v, _mm_shuffle_ps(v, v, 1)));
+    }
+
+    static float max(Vector v) {
+        v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+    }
+};
+
+typedef Double TileDouble;
+typedef Float TileFloat;
+
+#include "kernelsimpl.h"
+
+// Sign-extends the low and high eight bytes to 16 bits.
+inline void widen(__m128i v, __m128i &low, __m128i &high) {
+    low = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+    high = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+}
+
+inline int32_t sum(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+int32_t dot8(int n, const int8_t *x, const int8_t *y) {
+    __m128i s = _mm_setzero_si128();
+
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i xl, xh, yl, yh;
+        widen(_mm_loadu_si128((const __m128i *)(x + i)), xl, xh);
+        widen(_mm_loadu_si128((const __m128i *)(y + i)), yl, yh);
+
+        s = _mm_add_epi32(s, _mm_add_epi32(_mm_madd_epi16(xl, yl), _mm_madd_epi16(xh, yh)));
+    }
+
+    return sum(s) + kernels::dot8<int8_t>(n - i, x + i, y + i);
+}
+
+void dot8x4(int n, const int8_t *const *x, const int8_t *y, int32_t *s) {
+    __m128i acc[TileRows];
+
+    for (int r = 0; r < TileRows; r++)
+        acc[r] = _mm_setzero_si128();
+
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i yl, yh;
+        widen(_mm_loadu_si128((const __m128i *)(y + i)), yl, yh);
+
+        for (int r = 0; r < TileRows; r++) {
+            __m128i xl, xh;
+            widen(_mm_loadu_si128((const __m128i *)(x[r] + i)), xl, xh);
+
+            acc[r] = _mm_add_epi32(acc[r], _mm_add_epi32(_mm_madd_epi16(xl, yl), _mm_madd_epi16(xh, yh)));
+        }
+    }
+
+    for (int r = 0; r < TileRows; r++)
+        s[r] += sum(acc[r]) + kernels::dot8<int8_t>(n - i, x[r] + i, y + i);
+}
+
+void bytesToFloat(int n, const uint8_t *x, float divisor, float *y) {
+    __m128 d = _mm_set1_ps(divisor);
+    __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+        __m128i low = _mm_unpacklo_epi8(v, zero), high = _mm_unpackhi_epi8(v, zero);
+
+        _mm_storeu_ps(y + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), d));
+        _mm_storeu_ps(y + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), d));
+        _mm_storeu_ps(y + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), d));
+        _mm_storeu_ps(y + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), d));
+    }
+
+    kernels::bytesToFloat<uint8_t>(n - i, x + i, divisor, y + i);
+}
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+namespace avx2 {
+struct Double {
+    typedef double Scalar;
+    typedef __m256d Vector;
+
+    enum { Size = 4 };
+
+    static Vector zero() { return _mm256_setzero_pd(); }
+    static Vector set(double x) { return _mm256_set1_pd(x); }
+    static Vector load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, Vector v) { _mm256_storeu_pd(p, v); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm256_div_pd(a, b); }
+    static Vector sqrt(Vector a) { return _mm256_sqrt_pd(a); }
+    static Vector max(Vector a, Vector b) { return _mm256_max_pd(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm256_min_pd(a, b); }
+    static Vector madd(Vector a, Vector b, Vector c) { return _mm256_fmadd_pd(a, b, c); }
+    static double madd(double a, double b, double c) { return __builtin_fma(a, b, c); }
+
+    static Vector pow2(Vector k) {
+        return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(_mm256_add_pd(k, set(4503599627370496.0 + 1023))), 52));
+    }
+
+    static double sum(Vector v) {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+
+    static double max(Vector v) {
+        __m128d m = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_max_sd(m, _mm_unpackhi_pd(m, m)));
+    }
+};
+
+struct Float {
+    typedef float Scalar;
+    typedef __m256 Vector;
+
+    enum { Size = 8 };
+
+    static Vector zero() { return _mm256_setzero_ps(); }
+    static Vector set(float x) { return _mm256_set1_ps(x); }
+    static Vector load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, Vector v) { _mm256_storeu_ps(p, v); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm256_div_ps(a, b); }
+    static Vector sqrt(Vector a) { return _mm256_sqrt_ps(a); }
+    static Vector max(Vector a, Vector b) { return _mm256_max_ps(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    static Vector madd(Vector a, Vector b, Vector c) { return _mm256_fmadd_ps(a, b, c); }
+    static float madd(float a, float b, float c) { return __builtin_fmaf(a, b, c); }
+
+    static Vector pow2(Vector k) {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_castps_si256(_mm256_add_ps(k, set(8388608.0f + 127))), 23));
+    }
+
+    static float sum(Vector v) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+    }
+
+    static float max(Vector v) {
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+    }
+};
+
+typedef Double TileDouble;
+typedef Float TileFloat;
+
+#include "kernelsimpl.h"
+
+inline __m256i load8(const int8_t *p) {
+    return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+inline int32_t sum(__m256i v) {
+    return sse2::sum(_mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+int32_t dot8(int n, const int8_t *x, const int8_t *y) {
+    __m256i s = _mm256_setzero_si256();
+
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+        s = _mm256_add_epi32(s, _mm256_madd_epi16(load8(x + i), load8(y + i)));
+
+    return sum(s) + kernels::dot8<int8_t>(n - i, x + i, y + i);
+}
+
+void dot8x4(int n, const int8_t *const *x, const int8_t *y, int32_t *s) {
+    __m256i acc[TileRows];
+
+    for (int r = 0; r < TileRows; r++)
+        acc[r] = _mm256_setzero_si256();
+
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = load8(y + i);
+
+        for (int r = 0; r < TileRows; r++)
+            acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(load8(x[r] + i), v));
+    }
+
+    for (int r = 0; r < TileRows; r++)
+        s[r] += sum(acc[r]) + kernels::dot8<int8_t>(n - i, x[r] + i, y + i);
+}
+
+void bytesToFloat(int n, const uint8_t *x, float divisor, float *y) {
+    __m256 d = _mm256_set1_ps(divisor);
+
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i low = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(x + i)));
+        __m256i high = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(x + i + 8)));
+
+        _mm256_storeu_ps(y + i, _mm256_div_ps(_mm256_cvtepi32_ps(low), d));
+        _mm256_storeu_ps(y + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(high), d));
+    }
+
+    kernels::bytesToFloat<uint8_t>(n - i, x + i, divisor, y + i);
+}
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+namespace avx512 {
+struct Double {
+    typedef double Scalar;
+    typedef __m512d Vector;
+
+    enum { Size = 8 };
+
+    static Vector zero() { return _mm512_setzero_pd(); }
+    static Vector set(double x) { return _mm512_set1_pd(x); }
+    static Vector load(const double *p) { return _mm512_loadu_pd(p); }
+    static void store(double *p, Vector v) { _mm512_storeu_pd(p, v); }
+    static Vector add(Vector a, Vector b) { return _mm512_add_pd(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm512_sub_pd(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm512_mul_pd(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm512_div_pd(a, b); }
+    static Vector sqrt(Vector a) { return _mm512_sqrt_pd(a); }
+    static Vector max(Vector a, Vector b) { return _mm512_max_pd(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm512_min_pd(a, b); }
+    static Vector madd(Vector a, Vector b, Vector c) { return _mm512_fmadd_pd(a, b, c); }
+    static double madd(double a, double b, double c) { return __builtin_fma(a, b, c); }
+    static Vector pow2(Vector k) { return _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_castpd_si512(add(k, set(4503599627370496.0 + 1023))), 52)); }
+    static double sum(Vector v) { return _mm512_reduce_add_pd(v); }
+    static double max(Vector v) { return _mm512_reduce_max_pd(v); }
+};
+
+struct Float {
+    typedef float Scalar;
+    typedef __m512 Vector;
+
+    enum { Size = 16 };
+
+    static Vector zero() { return _mm512_setzero_ps(); }
+    static Vector set(float x) { return _mm512_set1_ps(x); }
+    static Vector load(const float *p) { return _mm512_loadu_ps(p); }
+    static void store(float *p, Vector v) { _mm512_storeu_ps(p, v); }
+    static Vector add(Vector a, Vector b) { return _mm512_add_ps(a, b); }
+    static Vector sub(Vector a, Vector b) { return _mm512_sub_ps(a, b); }
+    static Vector mul(Vector a, Vector b) { return _mm512_mul_ps(a, b); }
+    static Vector div(Vector a, Vector b) { return _mm512_div_ps(a, b); }
+    static Vector sqrt(Vector a) { return _mm512_sqrt_ps(a); }
+    static Vector max(Vector a, Vector b) { return _mm512_max_ps(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm512_min_ps(a, b); }
+    static Vector madd(Vector a, Vector b, Vector c) { return _mm512_fmadd_ps(a, b, c); }
+    static float madd(float a, float b, float c) { return __builtin_fmaf(a, b, c); }
+    static Vector pow2(Vector k) { return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_castps_si512(add(k, set(8388608.0f + 127))), 23)); }
+    static float sum(Vector v) { return _mm512_reduce_add_ps(v); }
+    static float max(Vector v) { return _mm512_reduce_max_ps(v); }
+};
+
+typedef Double TileDouble;
+typedef avx2::Float TileFloat;
+
+#include "kernelsimpl.h"
+}
+
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+#endif
+
+namespace {
+Isa current = Scalar;
+
+template <class T>
+Table<T> scalarTable() {
+    Table<T> t = {&axpy<T>, &axpy4<T>, &dot<T>, &dot4<T>, &tile<T>, &add<T>, &mul<T>, &div<T>, &max<T>, &momentum<T>, &nesterov<T>, &adam<T>, &rmsprop<T>, &fastTanh<T>, &fastExp<T>};
+    return t;
+}
+
+bool supported(Isa isa) {
+#ifdef NEURO_X86
+    __builtin_cpu_init();
+
+    switch (isa) {
+    case Scalar:
+        return true;
+
+    case SSE2:
+        return __builtin_cpu_supports("sse2");
+
+    case AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    case AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+
+    return false;
+#else
+    return isa == Scalar;
+#endif
+}
+
+struct Initializer {
+    Initializer() {
+        setIsa(bestIsa());
+    }
+} initializer;
+}
+
+Isa isa() {
+    return current;
+}
+
+Isa bestIsa() {
+    if (supported(AVX512))
+        return AVX512;
+
+    if (supported(AVX2))
+        return AVX2;
+
+    if (supported(SSE2))
+        return SSE2;
+
+    return Scalar;
+}
+
+bool setIsa(Isa isa) {
+    if (!supported(isa))
+        return false;
+
+    switch (isa) {
+    case Scalar:
+        doubleTable = scalarTable<double>();
+        floatTable = scalarTable<float>();
+        integerTable.dot8 = &dot8<int8_t>;
+        integerTable.dot8x4 = &dot8x4<int8_t>;
+        integerTable.bytesToFloat = &bytesToFloat<uint8_t>;
+        break;
+
+#ifdef NEURO_X86
+    case SSE2:
+        doubleTable = sse2::table<sse2::Double, sse2::TileDouble>();
+        floatTable = sse2::table<sse2::Float, sse2::TileFloat>();
+        integerTable.dot8 = &sse2::dot8;
+        integerTable.dot8x4 = &sse2::dot8x4;
+        integerTable.bytesToFloat = &sse2::bytesToFloat;
+        break;
+
+    case AVX2:
+        doubleTable = avx2::table<avx2::Double, avx2::TileDouble>();
+        floatTable = avx2::table<avx2::Float, avx2::TileFloat>();
+        integerTable.dot8 = &avx2::dot8;
+        integerTable.dot8x4 = &avx2::dot8x4;
+        integerTable.bytesToFloat = &avx2::bytesToFloat;
+        break;
+
+    case AVX512:
+        doubleTable = avx512::table<avx512::Double, avx512::TileDouble>();
+        floatTable = avx512::table<avx512::Float, avx512::TileFloat>();
+        // Widening int8 to 512 bits needs AVX-512BW, which is not required here.
+        integerTable.dot8 = &avx2::dot8;
+        integerTable.dot8x4 = &avx2::dot8x4;
+        integerTable.bytesToFloat = &avx2::bytesToFloat;
+        break;
+#else
+    default:
+        return false;
+#endif
+    }
+
+    current = isa;
+
+    return true;
+}
+
+const char *isaName(Isa isa) {
+    switch (isa) {
+    case Scalar:
+        return "scalar";
+
+    case SSE2:
+        return "sse2";
+
+    case AVX2:
+        return "avx2";
+
+    case AVX512:
+        return "avx512";
+    }
+
+    return "unknown";
+}
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <cstring>
+
+namespace kernels {
+
+enum Isa {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+enum {
+    TileRows = 4,
+    TileColumns = 8
+};
+
+// The widest supported instruction set is selected at startup. AVX2 and AVX-512
+// kernels use fused multiply-add, so results may differ from the scalar ones in
+// the last few bits; setIsa(Scalar) restores the reference behaviour.
+Isa isa();
+Isa bestIsa();
+bool setIsa(Isa isa);
+const char *isaName(Isa isa);
+
+// Parameters of one fused optimizer step. The gradient seen by the update rule is
+// (decay * w + dw) * scale; dw is cleared as it is consumed.
+template <class T>
+struct Step {
+    T learningRate;
+    T momentum;
+    T decay;
+    T scale;
+    T beta1;
+    T beta2;
+    T epsilon;
+};
+
+template <class T>
+struct Table {
+    void (*axpy)(int n, T a, const T *x, T *y);
+    void (*axpy4)(int n, const T *a, const T *const *x, T *y);
+    T (*dot)(int n, const T *x, const T *y, T s);
+    void (*dot4)(int n, const T *const *x, const T *y, T *s);
+    void (*tile)(int k, const T *a, int lda, const T *b, int ldb, T *c, int ldc);
+    void (*add)(int n, const T *x, T *y);
+    void (*mul)(int n, T a, const T *x, T *y);
+    void (*div)(int n, T a, T *x);
+    T (*max)(int n, const T *x);
+    void (*momentum)(int n, T *w, T *dw, T *v, const Step<T> &step);
+    void (*nesterov)(int n, T *w, T *dw, T *v, const Step<T> &step);
+    void (*adam)(int n, T *w, T *dw, T *m, T *v, const Step<T> &step);
+    void (*rmsprop)(int n, T *w, T *dw, T *s, const Step<T> &step);
+    void (*fastTanh)(int n, T *x);
+    T (*fastExp)(int n, T shift, T *x);
+};
+
+extern Table<double> doubleTable;
+extern Table<float> floatTable;
+
+// Kernels on bytes: int8 products summed exactly in int32 for quantized
+// inference, and unsigned bytes to float for image decoding.
+struct IntegerTable {
+    int32_t (*dot8)(int n, const int8_t *x, const int8_t *y);
+    void (*dot8x4)(int n, const int8_t *const *x, const int8_t *y, int32_t *s);
+    void (*bytesToFloat)(int n, const uint8_t *x, float divisor, float *y);
+};
+
+extern IntegerTable integerTable;
+
+template <class T>
+inline void axpy(int n, T a, const T *x, T *y) {
+    for (int j = 0; j < n; j++)
+        y[j] += x[j] * a;
+}
+
+template <class T>
+inline void axpy4(int n, const T *a, const T *const *x, T *y) {
+    for (int j = 0; j < n; j++)
+        y[j] = y[j] + x[0][j] * a[0] + x[1][j] * a[1] + x[2][j] * a[2] + x[3][j] * a[3];
+}
+
+template <class T>
+inline T dot(int n, const T *x, const T *y, T s) {
+    for (int i = 0; i < n; i++)
+        s += x[i] * y[i];
+
+    return s;
+}
+
+template <class T>
+inline void dot4(int n, const T *const *x, const T *y, T *s) {
+    for (int i = 0; i < n; i++)
+        for (int r = 0; r < TileRows; r++)
+            s[r] += x[r][i] * y[i];
+}
+
+template <class T>
+inline void tile(int k, const T *a, int lda, const T *b, int ldb, T *c, int ldc) {
+    for (int p = 0; p < k; p++)
+        for (int r = 0; r < TileRows; r++)
+            for (int s = 0; s < TileColumns; s++)
+                c[r * ldc + s] += a[r * lda + p] * b[p * ldb + s];
+}
+
+template <class T>
+inline void add(int n, const T *x, T *y) {
+    for (int j = 0; j < n; j++)
+        y[j] += x[j];
+}
+
+template <class T>
+inline void mul(int n, T a, const T *x, T *y) {
+    for (int j = 0; j < n; j++)
+        y[j] = a * x[j];
+}
+
+template <class T>
+inline void div(int n, T a, T *x) {
+    for (int j = 0; j < n; j++)
+        x[j] /= a;
+}
+
+template <class T>
+inline T max(int n, const T *x) {
+    T m = x[0];
+
+    for (int j = 1; j < n; j++)
+        m = std::max(m, x[j]);
+
+    return m;
+}
+
+template <class T>
+inline void momentum(int n, T *w, T *dw, T *v, const Step<T> &step) {
+    for (int j = 0; j < n; j++) {
+        T g = (step.decay * w[j] + dw[j]) * step.scale;
+
+        v[j] = step.momentum * v[j] - step.learningRate * g;
+        w[j] += v[j];
+        dw[j] = 0;
+    }
+}
+
+template <class T>
+inline void nesterov(int n, T *w, T *dw, T *v, const Step<T> &step) {
+    for (int j = 0; j < n; j++) {
+        T g = (step.decay * w[j] + dw[j]) * step.scale;
+        T previous = v[j];
+
+        v[j] = step.momentum * v[j] - step.learningRate * g;
+        w[j] += (1 + step.momentum) * v[j] - step.momentum * previous;
+        dw[j] = 0;
+    }
+}
+
+// Adam with the bias corrections folded in by the caller: learningRate is
+// lr * sqrt(1 - beta2^t) / (1 - beta1^t) and epsilon is eps * sqrt(1 - beta2^t).
+template <class T>
+inline void adam(int n, T *w, T *dw, T *m, T *v, const Step<T> &step) {
+    for (int j = 0; j < n; j++) {
+        T g = (step.decay * w[j] + dw[j]) * step.scale;
+
+        m[j] = step.beta1 * m[j] + (1 - step.beta1) * g;
+        v[j] = step.beta2 * v[j] + (1 - step.beta2) * g * g;
+        w[j] -= step.learningRate * m[j] / (std::sqrt(v[j]) + step.epsilon);
+        dw[j] = 0;
+    }
+}
+
+template <class T>
+inline void rmsprop(int n, T *w, T *dw, T *s, const Step<T> &step) {
+    for (int j = 0; j < n; j++) {
+        T g = (step.decay * w[j] + dw[j]) * step.scale;
+
+        s[j] = step.beta2 * s[j] + (1 - step.beta2) * g * g;
+        w[j] -= step.learningRate * g / (std::sqrt(s[j]) + step.epsilon);
+        dw[j] = 0;
+    }
+}
+
+// Fast exp: k = round(x / ln2), exp(r) for r = x - k ln2, |r| <= ln2 / 2, by a
+// degree 7 Taylor polynomial, scaled by 2^k. Relative error is below 1e-8 for
+// double and within 2 ulp for float; x is clamped so that 2^k stays a normal
+// number, which flushes results below about 1e-308 (1e-38 for float).
+template <class T>
+struct ExpConstants {
+    static constexpr T Log2e = 1.44269504088896340736;
+    // ln2 split so that k * Ln2Hi is exact.
+    static constexpr T Ln2Hi = 0.693359375;
+    static constexpr T Ln2Lo = -2.12194440054690582e-4;
+    static constexpr T Limit = (std::numeric_limits<T>::max_exponent - 2) * 0.693147180559945309;
+};
+
+// 2^k for integral k in the normal exponent range.
+inline double pow2(double k) {
+    uint64_t bits = (uint64_t)((int64_t)k + 1023) << 52;
+    double r;
+    memcpy(&r, &bits, sizeof(r));
+    return r;
+}
+
+inline float pow2(float k) {
+    uint32_t bits = (uint32_t)((int32_t)k + 127) << 23;
+    float r;
+    memcpy(&r, &bits, sizeof(r));
+    return r;
+}
+
+template <class T>
+inline T approximateExp(T x) {
+    typedef ExpConstants<T> C;
+
+    T limit = C::Limit;
+
+    x = std::min(std::max(x, -limit), limit);
+
+    T t = x * C::Log2e;
+    T k = (T)(int)(t < 0 ? t - T(0.5) : t + T(0.5));
+    T r = x - k * C::Ln2Hi - k * C::Ln2Lo;
+
+    T p = T(1) / 5040;
+    p = p * r + T(1) / 720;
+    p = p * r + T(1) / 120;
+    p = p * r + T(1) / 24;
+    p = p * r + T(1) / 6;
+    p = p * r + T(1) / 2;
+    p = p * r + 1;
+    p = p * r + 1;
+
+    return p * pow2(k);
+}
+
+// Fast tanh as 1 - 2 / (exp(2x) + 1) on the fast exp; absolute error is below
+// 1e-8 for double and 2e-7 for float.
+template <class T>
+inline void fastTanh(int n, T *x) {
+    for (int j = 0; j < n; j++)
+        x[j] = 1 - 2 / (approximateExp(2 * x[j]) + 1);
+}
+
+// x[j] = exp(x[j] - shift) by the fast exp; returns the sum of the results.
+template <class T>
+inline T fastExp(int n, T shift, T *x) {
+    T s = 0;
+
+    for (int j = 0; j < n; j++)
+        s += x[j] = approximateExp(x[j] - shift);
+
+    return s;
+}
+
+template <class T>
+inline int32_t dot8(int n, const T *x, const T *y) {
+    int32_t s = 0;
+
+    for (int i = 0; i < n; i++)
+        s += (int32_t)x[i] * y[i];
+
+    return s;
+}
+
+template <class T>
+inline void dot8x4(int n, const T *const *x, const T *y, int32_t *s) {
+    for (int r = 0; r < TileRows; r++)
+        s[r] += dot8<T>(n, x[r], y);
+}
+
+// y[i] = x[i] / divisor, rounded as by a single float division.
+template <class T>
+inline void bytesToFloat(int n, const T *x, float divisor, float *y) {
+    for (int i = 0; i < n; i++)
+        y[i] = x[i] / divisor;
+}
+
+#define NEURO_KERNELS_DISPATCH(T, table)                                                \
+    inline void axpy(int n, T a, const T *x, T *y) {                                    \
+        table.axpy(n, a, x, y);                                                         \
+    }                                                                                   \
+    inline void axpy4(int n, const T *a, const T *const *x, T *y) {                     \
+        table.axpy4(n, a, x, y);                                                        \
+    }                                                                                   \
+    inline T dot(int n, const T *x, const T *y, T s) {                                  \
+        return table.dot(n, x, y, s);                                                   \
+    }                                                                                   \
+    inline void dot4(int n, const T *const *x, const T *y, T *s) {                      \
+        table.dot4(n, x, y, s);                                                         \
+    }                                                                                   \
+    inline void tile(int k, const T *a, int lda, const T *b, int ldb, T *c, int ldc) {  \
+        table.tile(k, a, lda, b, ldb, c, ldc);                                          \
+    }                                                                                   \
+    inline void add(int n, const T *x, T *y) {                                          \
+        table.add(n, x, y);                                                             \
+    }                                                                                   \
+    inline void mul(int n, T a, const T *x, T *y) {                                     \
+        table.mul(n, a, x, y);                                                          \
+    }                                                                                   \
+    inline void div(int n, T a, T *x) {                                                 \
+        table.div(n, a, x);                                                             \
+    }                                                                                   \
+    inline T max(int n, const T *x) {                                                   \
+        return table.max(n, x);                                                         \
+    }                                                                                   \
+    inline void momentum(int n, T *w, T *dw, T *v, const Step<T> &step) {               \
+        table.momentum(n, w, dw, v, step);                                              \
+    }                                                                                   \
+    inline void nesterov(int n, T *w, T *dw, T *v, const Step<T> &step) {               \
+        table.nesterov(n, w, dw, v, step);                                              \
+    }                                                                                   \
+    inline void adam(int n, T *w, T *dw, T *m, T *v, const Step<T> &step) {            \
+        table.adam(n, w, dw, m, v, step);                                               \
+    }                                                                                   \
+    inline void rmsprop(int n, T *w, T *dw, T *s, const Step<T> &step) {                \
+        table.rmsprop(n, w, dw, s, step);                                               \
+    }                                                                                   \
+    inline void fastTanh(int n, T *x) {                                                 \
+        table.fastTanh(n, x);                                                           \
+    }                                                                                   \
+    inline T fastExp(int n, T shift, T *x) {                                            \
+        return table.fastExp(n, shift, x);                                              \
+    }
+
+NEURO_KERNELS_DISPATCH(double, doubleTable)
+NEURO_KERNELS_DISPATCH(float, floatTable)
+
+#undef NEURO_KERNELS_DISPATCH
+
+inline int32_t dot8(int n, const int8_t *x, const int8_t *y) {
+    return integerTable.dot8(n, x, y);
+}
+
+inline void dot8x4(int n, const int8_t *const *x, const int8_t *y, int32_t *s) {
+    integerTable.dot8x4(n, x, y, s);
+}
+
+inline void bytesToFloat(int n, const uint8_t *x, float divisor, float *y) {
+    integerTable.bytesToFloat(n, x, divisor, y);
+}
+}
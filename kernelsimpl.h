@@ -0,0 +1,345 @@
+// Vectorized kernel bodies. Included by kernels.cpp once per instruction set,
+// inside a namespace that defines the Double and Float vector traits and
+// under the matching target pragma.
+
+template <class V>
+void axpy(int n, typename V::Scalar a, const typename V::Scalar *x, typename V::Scalar *y) {
+    typename V::Vector va = V::set(a);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size)
+        V::store(y + j, V::madd(V::load(x + j), va, V::load(y + j)));
+
+    for (; j < n; j++)
+        y[j] = V::madd(x[j], a, y[j]);
+}
+
+template <class V>
+void axpy4(int n, const typename V::Scalar *a, const typename V::Scalar *const *x, typename V::Scalar *y) {
+    typename V::Vector a0 = V::set(a[0]), a1 = V::set(a[1]), a2 = V::set(a[2]), a3 = V::set(a[3]);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size) {
+        typename V::Vector s = V::load(y + j);
+
+        s = V::madd(V::load(x[0] + j), a0, s);
+        s = V::madd(V::load(x[1] + j), a1, s);
+        s = V::madd(V::load(x[2] + j), a2, s);
+        s = V::madd(V::load(x[3] + j), a3, s);
+
+        V::store(y + j, s);
+    }
+
+    for (; j < n; j++) {
+        typename V::Scalar s = y[j];
+
+        s = V::madd(x[0][j], a[0], s);
+        s = V::madd(x[1][j], a[1], s);
+        s = V::madd(x[2][j], a[2], s);
+        s = V::madd(x[3][j], a[3], s);
+
+        y[j] = s;
+    }
+}
+
+template <class V>
+typename V::Scalar dot(int n, const typename V::Scalar *x, const typename V::Scalar *y, typename V::Scalar s) {
+    typename V::Vector s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+
+    int i = 0;
+
+    for (; i + 4 * V::Size <= n; i += 4 * V::Size) {
+        s0 = V::madd(V::load(x + i), V::load(y + i), s0);
+        s1 = V::madd(V::load(x + i + V::Size), V::load(y + i + V::Size), s1);
+        s2 = V::madd(V::load(x + i + 2 * V::Size), V::load(y + i + 2 * V::Size), s2);
+        s3 = V::madd(V::load(x + i + 3 * V::Size), V::load(y + i + 3 * V::Size), s3);
+    }
+
+    for (; i + V::Size <= n; i += V::Size)
+        s0 = V::madd(V::load(x + i), V::load(y + i), s0);
+
+    s += V::sum(V::add(V::add(s0, s1), V::add(s2, s3)));
+
+    for (; i < n; i++)
+        s = V::madd(x[i], y[i], s);
+
+    return s;
+}
+
+template <class V>
+void dot4(int n, const typename V::Scalar *const *x, const typename V::Scalar *y, typename V::Scalar *s) {
+    typename V::Vector s0 = V::zero(), s1 = V::zero(), s2 = V::zero(), s3 = V::zero();
+
+    int i = 0;
+
+    for (; i + V::Size <= n; i += V::Size) {
+        typename V::Vector v = V::load(y + i);
+
+        s0 = V::madd(V::load(x[0] + i), v, s0);
+        s1 = V::madd(V::load(x[1] + i), v, s1);
+        s2 = V::madd(V::load(x[2] + i), v, s2);
+        s3 = V::madd(V::load(x[3] + i), v, s3);
+    }
+
+    s[0] += V::sum(s0);
+    s[1] += V::sum(s1);
+    s[2] += V::sum(s2);
+    s[3] += V::sum(s3);
+
+    for (; i < n; i++)
+        for (int r = 0; r < TileRows; r++)
+            s[r] = V::madd(x[r][i], y[i], s[r]);
+}
+
+template <class V>
+void tile(int k, const typename V::Scalar *a, int lda, const typename V::Scalar *b, int ldb, typename V::Scalar *c, int ldc) {
+    enum { Columns = TileColumns / V::Size };
+
+    typename V::Vector acc[TileRows][Columns];
+
+    for (int r = 0; r < TileRows; r++)
+        for (int s = 0; s < Columns; s++)
+            acc[r][s] = V::load(c + r * ldc + s * V::Size);
+
+    for (int p = 0; p < k; p++) {
+        const typename V::Scalar *bp = b + p * ldb;
+
+        typename V::Vector bv[Columns];
+
+        for (int s = 0; s < Columns; s++)
+            bv[s] = V::load(bp + s * V::Size);
+
+        for (int r = 0; r < TileRows; r++) {
+            typename V::Vector x = V::set(a[r * lda + p]);
+
+            for (int s = 0; s < Columns; s++)
+                acc[r][s] = V::madd(bv[s], x, acc[r][s]);
+        }
+    }
+
+    for (int r = 0; r < TileRows; r++)
+        for (int s = 0; s < Columns; s++)
+            V::store(c + r * ldc + s * V::Size, acc[r][s]);
+}
+
+template <class V>
+void add(int n, const typename V::Scalar *x, typename V::Scalar *y) {
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size)
+        V::store(y + j, V::add(V::load(y + j), V::load(x + j)));
+
+    for (; j < n; j++)
+        y[j] += x[j];
+}
+
+template <class V>
+void mul(int n, typename V::Scalar a, const typename V::Scalar *x, typename V::Scalar *y) {
+    typename V::Vector va = V::set(a);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size)
+        V::store(y + j, V::mul(va, V::load(x + j)));
+
+    for (; j < n; j++)
+        y[j] = a * x[j];
+}
+
+template <class V>
+void div(int n, typename V::Scalar a, typename V::Scalar *x) {
+    typename V::Vector va = V::set(a);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size)
+        V::store(x + j, V::div(V::load(x + j), va));
+
+    for (; j < n; j++)
+        x[j] /= a;
+}
+
+template <class V>
+typename V::Scalar max(int n, const typename V::Scalar *x) {
+    typename V::Scalar m = x[0];
+
+    int j = 0;
+
+    if (n >= V::Size) {
+        typename V::Vector vm = V::load(x);
+
+        for (j = V::Size; j + V::Size <= n; j += V::Size)
+            vm = V::max(vm, V::load(x + j));
+
+        m = V::max(vm);
+    }
+
+    for (; j < n; j++)
+        m = std::max(m, x[j]);
+
+    return m;
+}
+
+template <class V>
+typename V::Vector gradient(const typename V::Scalar *w, const typename V::Scalar *dw, const Step<typename V::Scalar> &step) {
+    return V::mul(V::madd(V::set(step.decay), V::load(w), V::load(dw)), V::set(step.scale));
+}
+
+template <class V>
+void momentum(int n, typename V::Scalar *w, typename V::Scalar *dw, typename V::Scalar *v, const Step<typename V::Scalar> &step) {
+    typename V::Vector mu = V::set(step.momentum), rate = V::set(step.learningRate);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size) {
+        typename V::Vector g = gradient<V>(w + j, dw + j, step);
+        typename V::Vector vj = V::sub(V::mul(mu, V::load(v + j)), V::mul(rate, g));
+
+        V::store(v + j, vj);
+        V::store(w + j, V::add(V::load(w + j), vj));
+        V::store(dw + j, V::zero());
+    }
+
+    kernels::momentum<typename V::Scalar>(n - j, w + j, dw + j, v + j, step);
+}
+
+template <class V>
+void nesterov(int n, typename V::Scalar *w, typename V::Scalar *dw, typename V::Scalar *v, const Step<typename V::Scalar> &step) {
+    typename V::Vector mu = V::set(step.momentum), mu1 = V::set(1 + step.momentum), rate = V::set(step.learningRate);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size) {
+        typename V::Vector g = gradient<V>(w + j, dw + j, step);
+        typename V::Vector previous = V::load(v + j);
+        typename V::Vector vj = V::sub(V::mul(mu, previous), V::mul(rate, g));
+
+        V::store(v + j, vj);
+        V::store(w + j, V::add(V::load(w + j), V::sub(V::mul(mu1, vj), V::mul(mu, previous))));
+        V::store(dw + j, V::zero());
+    }
+
+    kernels::nesterov<typename V::Scalar>(n - j, w + j, dw + j, v + j, step);
+}
+
+template <class V>
+void adam(int n, typename V::Scalar *w, typename V::Scalar *dw, typename V::Scalar *m, typename V::Scalar *v, const Step<typename V::Scalar> &step) {
+    typename V::Vector b1 = V::set(step.beta1), c1 = V::set(1 - step.beta1);
+    typename V::Vector b2 = V::set(step.beta2), c2 = V::set(1 - step.beta2);
+    typename V::Vector rate = V::set(step.learningRate), eps = V::set(step.epsilon);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size) {
+        typename V::Vector g = gradient<V>(w + j, dw + j, step);
+        typename V::Vector mj = V::add(V::mul(b1, V::load(m + j)), V::mul(c1, g));
+        typename V::Vector vj = V::add(V::mul(b2, V::load(v + j)), V::mul(c2, V::mul(g, g)));
+
+        V::store(m + j, mj);
+        V::store(v + j, vj);
+        V::store(w + j, V::sub(V::load(w + j), V::div(V::mul(rate, mj), V::add(V::sqrt(vj), eps))));
+        V::store(dw + j, V::zero());
+    }
+
+    kernels::adam<typename V::Scalar>(n - j, w + j, dw + j, m + j, v + j, step);
+}
+
+template <class V>
+void rmsprop(int n, typename V::Scalar *w, typename V::Scalar *dw, typename V::Scalar *s, const Step<typename V::Scalar> &step) {
+    typename V::Vector b2 = V::set(step.beta2), c2 = V::set(1 - step.beta2);
+    typename V::Vector rate = V::set(step.learningRate), eps = V::set(step.epsilon);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size) {
+        typename V::Vector g = gradient<V>(w + j, dw + j, step);
+        typename V::Vector sj = V::add(V::mul(b2, V::load(s + j)), V::mul(c2, V::mul(g, g)));
+
+        V::store(s + j, sj);
+        V::store(w + j, V::sub(V::load(w + j), V::div(V::mul(rate, g), V::add(V::sqrt(sj), eps))));
+        V::store(dw + j, V::zero());
+    }
+
+    kernels::rmsprop<typename V::Scalar>(n - j, w + j, dw + j, s + j, step);
+}
+
+// Vector form of kernels::approximateExp; rounds k to nearest even by adding
+// and subtracting 1.5 * 2^(mantissa bits).
+template <class V>
+typename V::Vector exp(typename V::Vector x) {
+    typedef typename V::Scalar T;
+    typedef ExpConstants<T> C;
+
+    typename V::Vector shifter = V::set(std::ldexp(T(1.5), std::numeric_limits<T>::digits - 1));
+
+    x = V::max(V::min(x, V::set(C::Limit)), V::set(-C::Limit));
+
+    typename V::Vector k = V::sub(V::madd(x, V::set(C::Log2e), shifter), shifter);
+    typename V::Vector r = V::madd(k, V::set(-C::Ln2Lo), V::madd(k, V::set(-C::Ln2Hi), x));
+
+    typename V::Vector p = V::set(T(1) / 5040);
+    p = V::madd(p, r, V::set(T(1) / 720));
+    p = V::madd(p, r, V::set(T(1) / 120));
+    p = V::madd(p, r, V::set(T(1) / 24));
+    p = V::madd(p, r, V::set(T(1) / 6));
+    p = V::madd(p, r, V::set(T(1) / 2));
+    p = V::madd(p, r, V::set(T(1)));
+    p = V::madd(p, r, V::set(T(1)));
+
+    return V::mul(p, V::pow2(k));
+}
+
+template <class V>
+void fastTanh(int n, typename V::Scalar *x) {
+    typename V::Vector one = V::set(1), two = V::set(2);
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size) {
+        typename V::Vector e = exp<V>(V::mul(two, V::load(x + j)));
+        V::store(x + j, V::sub(one, V::div(two, V::add(e, one))));
+    }
+
+    kernels::fastTanh<typename V::Scalar>(n - j, x + j);
+}
+
+template <class V>
+typename V::Scalar fastExp(int n, typename V::Scalar shift, typename V::Scalar *x) {
+    typename V::Vector vs = V::set(shift), sum = V::zero();
+
+    int j = 0;
+
+    for (; j + V::Size <= n; j += V::Size) {
+        typename V::Vector e = exp<V>(V::sub(V::load(x + j), vs));
+
+        V::store(x + j, e);
+        sum = V::add(sum, e);
+    }
+
+    return V::sum(sum) + kernels::fastExp<typename V::Scalar>(n - j, shift, x + j);
+}
+
+template <class V, class TV>
+Table<typename V::Scalar> table() {
+    Table<typename V::Scalar> t = {
+        &axpy<V>,
+        &axpy4<V>,
+        &dot<V>,
+        &dot4<V>,
+        &tile<TV>,
+        &add<V>,
+        &mul<V>,
+        &div<V>,
+        &max<V>,
+        &momentum<V>,
+        &nesterov<V>,
+        &adam<V>,
+        &rmsprop<V>,
+        &fastTanh<V>,
+        &fastExp<V>
+    };
+
+    return t;
+}
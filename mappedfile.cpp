@@ -0,0 +1,125 @@
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &fileName)
+    : address(0), length(0), file(INVALID_HANDLE_VALUE), mapping(0) {
+    file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+
+    LARGE_INTEGER size;
+
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+        release();
+        throw std::runtime_error("cannot open " + fileName);
+    }
+
+    length = size.QuadPart;
+
+    if (length == 0)
+        return;
+
+    mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+
+    if (mapping)
+        address = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!address) {
+        release();
+        throw std::runtime_error("cannot map " + fileName);
+    }
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+void MappedFile::release() {
+    if (address)
+        UnmapViewOfFile(address);
+
+    if (mapping)
+        CloseHandle(mapping);
+
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &fileName)
+    : address(0), length(0) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+
+    struct stat info;
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0)
+            close(fd);
+
+        throw std::runtime_error("cannot open " + fileName);
+    }
+
+    length = info.st_size;
+
+    if (length > 0) {
+        void *p = mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("cannot map " + fileName);
+        }
+
+        address = (const char *)p;
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (address)
+        munmap((void *)address, length);
+}
+
+#endif
+
+const char *MappedFile::data() const {
+    return address;
+}
+
+std::size_t MappedFile::size() const {
+    return length;
+}
+
+void MappedFile::discard(std::size_t offset, std::size_t length) const {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    std::size_t page = info.dwPageSize;
+#else
+    std::size_t page = sysconf(_SC_PAGESIZE);
+#endif
+
+    std::size_t begin = (offset + page - 1) / page * page, end = (offset + length) / page * page;
+
+    if (begin >= end)
+        return;
+
+#ifdef _WIN32
+    // Unlocking pages that are not locked removes them from the working set.
+    VirtualUnlock((void *)(address + begin), end - begin);
+#else
+    madvise((void *)(address + begin), end - begin, MADV_DONTNEED);
+#endif
+}
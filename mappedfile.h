@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. Pages are shared with the OS page
+// cache, so every process mapping the same file uses one physical copy.
+class MappedFile {
+    const char *address;
+    std::size_t length;
+
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#endif
+
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped.
+    explicit MappedFile(const std::string &fileName);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const;
+    std::size_t size() const;
+
+    // Drops the whole pages within [offset, offset + length) from memory; they
+    // are read again from the file if touched later.
+    void discard(std::size_t offset, std::size_t length) const;
+
+#ifdef _WIN32
+private:
+    void release();
+#endif
+};
@@ -1,102 +1,286 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
+#include <algorithm>
 
+#include "kernels.h"
+#include "aligned.h"
+
+// Non-owning rows of a matrix, or of any buffer holding rows a fixed number
+// of elements apart. Cheap to copy; the products behind Matrix work on views.
+template <class T>
+class MatrixView {
+    T *p;
+    int h, w, s;
+
+public:
+    MatrixView(T *data, int h, int w, int stride);
+
+    // A view of writable rows is also a view of read-only ones.
+    template <class U>
+    MatrixView(const MatrixView<U> &view);
+
+    T *data() const;
+
+    int height() const;
+    int width() const;
+    int stride() const;
+
+    T *operator[](int i) const;
+
+    MatrixView rows(int first, int count) const;
+    MatrixView block(int row, int column, int height, int width) const;
+};
+
+// Row-major matrix in a 64-byte aligned block, so the first row starts on a
+// cache line. Rows are stride() elements apart: packed matrices have no gap
+// between rows, padded ones round every row up to a multiple of 64 bytes so
+// that each row starts on a cache line too. Rows narrower than PaddedRow bytes
+// are never padded; for them the gaps would cost more memory than aligned
+// loads save, and whole-matrix operations would have to go row by row. The
+// padding is never read or written by the operations below.
 template <class T>
 class Matrix {
+    enum {
+        RowBlock = kernels::TileRows,
+        ColumnBlock = kernels::TileColumns,
+        DepthBlock = 128,
+        WidthBlock = 256,
+        VectorBlock = 2048,
+        SmallProduct = 32 * 32 * 32,
+        PaddedRow = 8 * aligned::Alignment
+    };
+
     T *data;
-    int h, w;
+    int h, w, s;
+    bool owner;
 
 public:
+    enum Layout {
+        Packed,
+        Padded
+    };
+
     Matrix();
-    Matrix(int h, int w);
+    Matrix(int h, int w, Layout layout = Packed);
 
+    // Copies always own their values, also copies of a view.
     Matrix(const Matrix &m);
-    Matrix(Matrix &&m);
+    Matrix(Matrix &&m) noexcept;
 
     Matrix(const std::vector<std::vector<T>> &v);
 
+    // Keeps the source's layout.
+    template <class U>
+    explicit Matrix(const Matrix<U> &m);
+
     ~Matrix();
 
+    // Wraps h rows of w values, stride values apart (w when not given), owned
+    // elsewhere. The memory must outlive the matrix and whatever it is moved
+    // into; copies of a view are deep copies and do not refer to it.
+    static Matrix view(T *data, int h, int w);
+    static Matrix view(T *data, int h, int w, int stride);
+
+    // Copies keep the source's layout.
     Matrix &operator=(const Matrix &m);
-    Matrix &operator=(Matrix &&m);
+    Matrix &operator=(Matrix &&m) noexcept;
 
     int height() const;
     int width() const;
+    int stride() const;
+    // True if the rows follow each other without a gap, so all height() *
+    // width() values can be handed to a kernel as one vector.
+    bool isPacked() const;
 
     T at(int i, int j) const;
 
     T *operator[](int i);
+    const T *operator[](int i) const;
+
+    MatrixView<T> rows(int first, int count);
+    MatrixView<const T> rows(int first, int count) const;
 
-    Matrix<T> &operator+=(const Matrix<double> &m);
+    void fill(T value);
+
+    Matrix<T> &operator+=(const Matrix &m);
 
     std::vector<T> multiply(const std::vector<T> &v) const;
     std::vector<T> multiplyTransposed(const std::vector<T> &v) const;
+    Matrix multiply(const Matrix &m) const;
+
+    void multiply(const T *v, T *r) const;
+    void multiplyTransposed(const T *v, T *r) const;
+    void addOuterProduct(const T *a, const T *b);
+    // Adds a^T * b over the first count rows of a and b: the sum of count outer
+    // products, accumulated in the same order as count addOuterProduct() calls.
+    void addTransposedProduct(const Matrix &a, const Matrix &b, int count);
     Matrix transposed() const;
 
     static Matrix<T> multiply(const std::vector<T> &a, const std::vector<T> &b);
+
+private:
+    static int paddedStride(int w);
+
+    void allocate(int h, int w, int stride);
+    void release();
+
+    static void gemv(MatrixView<const T> a, const T *v, T *r);
+    static void gemvTransposed(MatrixView<const T> a, const T *v, T *r);
+    static void gemm(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c);
+    static void gemmSmall(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c);
+    static void gemmEdge(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c, int k0, int k1);
 };
 
+template <class T>
+MatrixView<T>::MatrixView(T *data, int h, int w, int stride)
+    : p(data), h(h), w(w), s(stride) {
+}
+
+template <class T>
+template <class U>
+MatrixView<T>::MatrixView(const MatrixView<U> &view)
+    : p(view.data()), h(view.height()), w(view.width()), s(view.stride()) {
+}
+
+template <class T>
+T *MatrixView<T>::data() const {
+    return p;
+}
+
+template <class T>
+int MatrixView<T>::height() const {
+    return h;
+}
+
+template <class T>
+int MatrixView<T>::width() const {
+    return w;
+}
+
+template <class T>
+int MatrixView<T>::stride() const {
+    return s;
+}
+
+template <class T>
+T *MatrixView<T>::operator[](int i) const {
+    return p + (std::size_t)i * s;
+}
+
+template <class T>
+MatrixView<T> MatrixView<T>::rows(int first, int count) const {
+    return MatrixView(p + (std::size_t)first * s, count, w, s);
+}
+
+template <class T>
+MatrixView<T> MatrixView<T>::block(int row, int column, int height, int width) const {
+    return MatrixView(p + (std::size_t)row * s + column, height, width, s);
+}
+
 template <class T>
 Matrix<T>::Matrix()
-    : data(0), h(0), w(0) {
+    : data(0), h(0), w(0), s(0), owner(true) {
 }
 
 template <class T>
-Matrix<T>::Matrix(int h, int w)
-    : h(h), w(w) {
-    data = new T[h * w];
+Matrix<T>::Matrix(int h, int w, Layout layout)
+    : data(0), owner(true) {
+    allocate(h, w, layout == Padded ? paddedStride(w) : w);
 }
 
 template <class T>
 Matrix<T>::Matrix(const Matrix &m)
-    : data(0), h(0), w(0) {
+    : data(0), h(0), w(0), s(0), owner(true) {
     *this = m;
 }
 
 template <class T>
 Matrix<T>::Matrix(const std::vector<std::vector<T>> &v)
-    : data(new T[v.size() * v[0].size()]), h(v.size()), w(v[0].size()) {
+    : data(0), owner(true) {
+    allocate(v.size(), v[0].size(), v[0].size());
+
     for (int i = 0; i < h; i++)
         std::copy(v[i].begin(), v[i].end(), (*this)[i]);
 }
 
 template <class T>
-Matrix<T>::Matrix(Matrix<T> &&m)
-    : data(0), h(0), w(0) {
+template <class U>
+Matrix<T>::Matrix(const Matrix<U> &m)
+    : data(0), owner(true) {
+    allocate(m.height(), m.width(), m.isPacked() ? m.width() : paddedStride(m.width()));
+
+    for (int i = 0; i < h; i++)
+        std::copy(m[i], m[i] + w, (*this)[i]);
+}
+
+template <class T>
+Matrix<T>::Matrix(Matrix<T> &&m) noexcept
+    : data(0), h(0), w(0), s(0), owner(true) {
     *this = std::move(m);
 }
 
 template <class T>
 Matrix<T>::~Matrix() {
-    delete[] data;
+    release();
+}
+
+template <class T>
+Matrix<T> Matrix<T>::view(T *data, int h, int w) {
+    return view(data, h, w, w);
+}
+
+template <class T>
+Matrix<T> Matrix<T>::view(T *data, int h, int w, int stride) {
+    Matrix<T> m;
+
+    m.data = data;
+    m.h = h;
+    m.w = w;
+    m.s = stride;
+    m.owner = false;
+
+    return m;
 }
 
 template <class T>
 Matrix<T> &Matrix<T>::operator=(const Matrix<T> &m) {
-    delete[] data;
+    if (this == &m)
+        return *this;
 
-    h = m.h;
-    w = m.w;
+    release();
 
-    data = new T[h * w];
+    // A view's stride can be anything; its copy gets the closest layout.
+    allocate(m.h, m.w, m.owner ? m.s : m.isPacked() ? m.w : paddedStride(m.w));
 
-    std::copy(m.data, m.data + h * w, data);
+    if (isPacked() && m.isPacked())
+        std::copy(m.data, m.data + (std::size_t)h * w, data);
+    else
+        for (int i = 0; i < h; i++)
+            std::copy(m[i], m[i] + w, (*this)[i]);
 
     return *this;
 }
 
 template <class T>
-Matrix<T> &Matrix<T>::operator=(Matrix<T> &&m) {
-    delete[] data;
+Matrix<T> &Matrix<T>::operator=(Matrix<T> &&m) noexcept {
+    if (this == &m)
+        return *this;
+
+    release();
 
     data = m.data;
     h = m.h;
     w = m.w;
+    s = m.s;
+    owner = m.owner;
 
     m.data = 0;
     m.h = 0;
     m.w = 0;
+    m.s = 0;
+    m.owner = true;
 
     return *this;
 }
@@ -111,52 +295,138 @@ int Matrix<T>::width() const {
     return w;
 }
 
+template <class T>
+int Matrix<T>::stride() const {
+    return s;
+}
+
+template <class T>
+bool Matrix<T>::isPacked() const {
+    return s == w || h <= 1;
+}
+
 template <class T>
 T Matrix<T>::at(int i, int j) const {
-    return data[i * w + j];
+    return data[(std::size_t)i * s + j];
 }
 
 template <class T>
 T *Matrix<T>::operator[](int i) {
-    return data + i * w;
+    return data + (std::size_t)i * s;
 }
 
 template <class T>
-Matrix<T> &Matrix<T>::operator+=(const Matrix<double> &m) {
-    for (int i = 0; i < h; i++)
-        for (int j = 0; j < w; j++)
-            (*this)[i][j] += m.at(i, j);
+const T *Matrix<T>::operator[](int i) const {
+    return data + (std::size_t)i * s;
+}
 
-    return *this;
+template <class T>
+MatrixView<T> Matrix<T>::rows(int first, int count) {
+    return MatrixView<T>((*this)[first], count, w, s);
 }
 
 template <class T>
-std::vector<T> Matrix<T>::multiply(const std::vector<T> &v) const {
-    std::vector<T> r(w);
-    std::fill(r.begin(), r.end(), (T)0);
+MatrixView<const T> Matrix<T>::rows(int first, int count) const {
+    return MatrixView<const T>((*this)[first], count, w, s);
+}
 
-    for (int j = 0; j < w; j++)
+template <class T>
+void Matrix<T>::fill(T value) {
+    if (isPacked())
+        std::fill(data, data + (std::size_t)h * w, value);
+    else
+        for (int i = 0; i < h; i++)
+            std::fill((*this)[i], (*this)[i] + w, value);
+}
+
+template <class T>
+Matrix<T> &Matrix<T>::operator+=(const Matrix<T> &m) {
+    if (isPacked() && m.isPacked())
+        kernels::add(h * w, m.data, data);
+    else
         for (int i = 0; i < h; i++)
-            r[j] += at(i, j) * v[i];
+            kernels::add(w, m[i], (*this)[i]);
+
+    return *this;
+}
 
+template <class T>
+std::vector<T> Matrix<T>::multiply(const std::vector<T> &v) const {
+    std::vector<T> r(w);
+    multiply(v.data(), r.data());
     return r;
 }
 
 template <class T>
 std::vector<T> Matrix<T>::multiplyTransposed(const std::vector<T> &v) const {
     std::vector<T> r(h);
-    std::fill(r.begin(), r.end(), (T)0);
+    multiplyTransposed(v.data(), r.data());
+    return r;
+}
+
+template <class T>
+Matrix<T> Matrix<T>::multiply(const Matrix<T> &m) const {
+    Matrix<T> r(h, m.w);
+    r.fill(0);
 
-    for (int j = 0; j < h; j++)
-        for (int i = 0; i < w; i++)
-            r[j] += at(j, i) * v[i];
+    if (h == 1)
+        gemv(m.rows(0, m.h), data, r.data);
+    else if ((long long)h * w * m.w < SmallProduct)
+        gemmSmall(rows(0, h), m.rows(0, m.h), r.rows(0, h));
+    else
+        gemm(rows(0, h), m.rows(0, m.h), r.rows(0, h));
 
     return r;
 }
 
+template <class T>
+void Matrix<T>::multiply(const T *v, T *r) const {
+    std::fill(r, r + w, (T)0);
+    gemv(rows(0, h), v, r);
+}
+
+template <class T>
+void Matrix<T>::multiplyTransposed(const T *v, T *r) const {
+    std::fill(r, r + h, (T)0);
+    gemvTransposed(rows(0, h), v, r);
+}
+
+template <class T>
+void Matrix<T>::addOuterProduct(const T *a, const T *b) {
+    for (int i = 0; i < h; i++)
+        kernels::axpy(w, a[i], b, (*this)[i]);
+}
+
+template <class T>
+void Matrix<T>::addTransposedProduct(const Matrix &a, const Matrix &b, int count) {
+    for (int j0 = 0; j0 < w; j0 += WidthBlock) {
+        int j1 = std::min(j0 + WidthBlock, w);
+
+        for (int k0 = 0; k0 < count; k0 += DepthBlock) {
+            int k1 = std::min(k0 + DepthBlock, count);
+
+            for (int i = 0; i < h; i++) {
+                T *r = (*this)[i] + j0;
+
+                int k = k0;
+
+                for (; k + RowBlock <= k1; k += RowBlock) {
+                    const T v[RowBlock] = {a[k][i], a[k + 1][i], a[k + 2][i], a[k + 3][i]};
+                    const T *rows[RowBlock] = {b[k] + j0, b[k + 1] + j0, b[k + 2] + j0, b[k + 3] + j0};
+
+                    kernels::axpy4(j1 - j0, v, rows, r);
+                }
+
+                for (; k < k1; k++)
+                    kernels::axpy(j1 - j0, a[k][i], b[k] + j0, r);
+            }
+        }
+    }
+}
+
 template <class T>
 Matrix<T> Matrix<T>::transposed() const {
-    Matrix r(h, w);
+    Matrix r(w, h);
 
     for (int j = 0; j < w; j++)
         for (int i = 0; i < h; i++)
@@ -170,8 +440,114 @@ Matrix<T> Matrix<T>::multiply(const std::vector<T> &a, const std::vector<T> &b)
     Matrix<T> r(a.size(), b.size());
 
     for (int i = 0; i < r.height(); i++)
-        for (int j = 0; j < r.width(); j++)
-            r[i][j] = a[i] * b[j];
+        kernels::mul(r.width(), a[i], b.data(), r[i]);
 
     return r;
 }
+
+template <class T>
+int Matrix<T>::paddedStride(int w) {
+    int n = aligned::Alignment / sizeof(T);
+
+    return w * sizeof(T) < PaddedRow ? w : (w + n - 1) / n * n;
+}
+
+template <class T>
+void Matrix<T>::allocate(int h, int w, int stride) {
+    data = (T *)aligned::allocate(std::max<std::size_t>((std::size_t)h * stride, 1) * sizeof(T));
+
+    this->h = h;
+    this->w = w;
+    s = stride;
+    owner = true;
+}
+
+template <class T>
+void Matrix<T>::release() {
+    if (owner)
+        aligned::deallocate(data);
+
+    data = 0;
+}
+
+template <class T>
+void Matrix<T>::gemv(MatrixView<const T> a, const T *v, T *r) {
+    int h = a.height(), w = a.width();
+
+    for (int j0 = 0; j0 < w; j0 += VectorBlock) {
+        int j1 = std::min(j0 + VectorBlock, w);
+
+        int i = 0;
+
+        for (; i + RowBlock <= h; i += RowBlock) {
+            const T *rows[RowBlock] = {a[i] + j0, a[i + 1] + j0, a[i + 2] + j0, a[i + 3] + j0};
+
+            kernels::axpy4(j1 - j0, v + i, rows, r + j0);
+        }
+
+        for (; i < h; i++)
+            kernels::axpy(j1 - j0, v[i], a[i] + j0, r + j0);
+    }
+}
+
+template <class T>
+void Matrix<T>::gemvTransposed(MatrixView<const T> a, const T *v, T *r) {
+    int h = a.height(), w = a.width();
+
+    for (int i0 = 0; i0 < w; i0 += VectorBlock) {
+        int i1 = std::min(i0 + VectorBlock, w);
+
+        int j = 0;
+
+        for (; j + RowBlock <= h; j += RowBlock) {
+            const T *rows[RowBlock] = {a[j] + i0, a[j + 1] + i0, a[j + 2] + i0, a[j + 3] + i0};
+
+            kernels::dot4(i1 - i0, rows, v + i0, r + j);
+        }
+
+        for (; j < h; j++)
+            r[j] = kernels::dot(i1 - i0, a[j] + i0, v + i0, r[j]);
+    }
+}
+
+template <class T>
+void Matrix<T>::gemm(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c) {
+    int m = a.height(), k = a.width(), n = b.width();
+
+    for (int k0 = 0; k0 < k; k0 += DepthBlock) {
+        int k1 = std::min(k0 + DepthBlock, k);
+
+        for (int j0 = 0; j0 < n; j0 += WidthBlock) {
+            int j1 = std::min(j0 + WidthBlock, n);
+
+            for (int i = 0; i < m; i += RowBlock) {
+                int mr = std::min((int)RowBlock, m - i);
+
+                for (int j = j0; j < j1; j += ColumnBlock) {
+                    int nr = std::min((int)ColumnBlock, j1 - j);
+
+                    if (mr == RowBlock && nr == ColumnBlock)
+                        kernels::tile(k1 - k0, a[i] + k0, a.stride(), b[k0] + j, b.stride(), c[i] + j, c.stride());
+                    else
+                        gemmEdge(a.rows(i, mr), b.block(0, j, k, nr), c.block(i, j, mr, nr), k0, k1);
+                }
+            }
+        }
+    }
+}
+
+template <class T>
+void Matrix<T>::gemmSmall(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c) {
+    for (int i = 0; i < a.height(); i++)
+        for (int p = 0; p < a.width(); p++)
+            kernels::axpy(b.width(), a[i][p], b[p], c[i]);
+}
+
+// Multiplies an edge block of at most RowBlock x ColumnBlock over the inner
+// indices [k0, k1).
+template <class T>
+void Matrix<T>::gemmEdge(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c, int k0, int k1) {
+    for (int r = 0; r < a.height(); r++)
+        for (int p = k0; p < k1; p++)
+            kernels::axpy(b.width(), a[r][p], b[p], c[r]);
+}
@@ -0,0 +1,747 @@
+#include "model.h"
+#include "mappedfile.h"
+#include "fileformat.h"
+#include "threadpool.h"
+#include "dataset.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+using namespace fileformat;
+
+namespace {
+const char Magic[8] = {'N', 'E', 'U', 'R', 'O', 'M', 'D', 'L'};
+
+enum {
+    Version = 2
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t scalarSize;
+    uint32_t layerCount;
+    uint64_t fileSize;
+    // Covers the whole file, with this field taken as zero.
+    uint64_t checksum;
+    char reserved[24];
+};
+
+struct FileLayer {
+    uint32_t height;
+    uint32_t width;
+    uint64_t offset;
+};
+
+uint64_t fileChecksum(const char *data, std::size_t size) {
+    FileHeader header;
+    memcpy(&header, data, sizeof(header));
+    header.checksum = 0;
+
+    return checksum(data + sizeof(header), size - sizeof(header), checksum((const char *)&header, sizeof(header)));
+}
+
+template <class U, class T>
+void convert(const char *data, Matrix<T> &m) {
+    const U *p = (const U *)data;
+
+    for (int i = 0; i < m.height(); i++)
+        std::copy(p + i * m.width(), p + (i + 1) * m.width(), m[i]);
+}
+}
+
+template <class T>
+BasicModel<T>::Workspace::Workspace() {
+}
+
+template <class T>
+BasicModel<T>::Workspace::Workspace(const BasicModel<T> &model)
+    : a(model.w.size() + 1) {
+    for (uint i = 0; i < model.w.size(); i++) {
+        a[i].assign(model.w[i].height(), 0);
+        a[i].back() = 1;
+    }
+
+    if (!model.w.empty())
+        a.back().assign(model.w.back().width(), 0);
+}
+
+template <class T>
+bool BasicModel<T>::Workspace::fits(const BasicModel<T> &model) const {
+    if (a.size() != model.w.size() + 1)
+        return false;
+
+    for (uint i = 0; i < model.w.size(); i++)
+        if (a[i].size() != (uint)model.w[i].height())
+            return false;
+
+    return a.back().size() == (uint)model.w.back().width();
+}
+
+template <class T>
+const std::vector<T> &BasicModel<T>::Workspace::output() const {
+    return a.back();
+}
+
+template <class T>
+BasicModel<T> BasicModel<T>::loadFromFile(const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+
+    if (!file)
+        throw std::runtime_error("cannot open " + fileName);
+
+    char magic[sizeof(Magic)];
+
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, Magic, sizeof(Magic)) != 0) {
+        file.clear();
+        file.seekg(0);
+
+        return loadLegacy(file);
+    }
+
+    file.seekg(0, std::ios::end);
+
+    std::vector<char> data(file.tellg());
+
+    file.seekg(0);
+    file.read(data.data(), data.size());
+
+    return load(data.data(), data.size(), std::shared_ptr<const MappedFile>(), Verify);
+}
+
+template <class T>
+BasicModel<T> BasicModel<T>::mapFile(const std::string &fileName, Verification verification) {
+    std::shared_ptr<const MappedFile> mapping = std::make_shared<MappedFile>(fileName);
+
+    if (mapping->size() < sizeof(Magic) || memcmp(mapping->data(), Magic, sizeof(Magic)) != 0)
+        return loadFromFile(fileName);
+
+    return load(mapping->data(), mapping->size(), mapping, verification);
+}
+
+template <class T>
+BasicModel<T> BasicModel<T>::loadLegacy(std::istream &file) {
+    std::streamoff start = file.tellg();
+    file.seekg(0, std::ios::end);
+
+    // Sizes are checked against what is left of the file before anything is
+    // allocated for them.
+    uint64_t remaining = file.tellg() - start;
+    file.seekg(start);
+
+    int size;
+    std::vector<int> sizes;
+
+    file.read((char *)&size, sizeof(int));
+
+    if (!file || size < 2 || (uint64_t)size > remaining / sizeof(int) - 1)
+        throw std::runtime_error("model file is truncated");
+
+    sizes.resize(size);
+
+    if (!file.read((char *)&sizes[0], sizeof(int) * size))
+        throw std::runtime_error("model file is truncated");
+
+    if (*std::min_element(sizes.begin(), sizes.end()) < 1)
+        throw std::runtime_error("model file has an invalid layer table");
+
+    remaining -= sizeof(int) * (size + 1);
+
+    for (uint i = 0; i < sizes.size() - 1; i++) {
+        uint64_t count = ((uint64_t)sizes[i] + 1) * sizes[i + 1];
+
+        if (count > remaining / sizeof(double))
+            throw std::runtime_error("model file is truncated");
+
+        remaining -= count * sizeof(double);
+    }
+
+    BasicModel<T> model;
+
+    model.w.reserve(sizes.size() - 1);
+
+    for (uint i = 0; i < sizes.size() - 1; i++) {
+        model.w.push_back(Matrix<T>(sizes[i] + 1, sizes[i + 1], Matrix<T>::Padded));
+        readMatrix(file, model.w.back());
+    }
+
+    if (!file)
+        throw std::runtime_error("model file is truncated");
+
+    return model;
+}
+
+template <class T>
+BasicModel<T> BasicModel<T>::load(const char *data, std::size_t size, const std::shared_ptr<const MappedFile> &mapping, Verification verification) {
+    FileHeader header;
+
+    if (size < sizeof(header))
+        throw std::runtime_error("model file is truncated");
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.byteOrder != ByteOrder)
+        throw std::runtime_error("model file has a different byte order");
+
+    if (header.version != Version)
+        throw std::runtime_error("unsupported model file version");
+
+    if (header.scalarSize != sizeof(float) && header.scalarSize != sizeof(double))
+        throw std::runtime_error("unsupported model scalar size");
+
+    if (header.fileSize != size || size % Alignment != 0 || sizeof(header) + (uint64_t)header.layerCount * sizeof(FileLayer) > size)
+        throw std::runtime_error("model file is truncated");
+
+    if (verification == Verify && fileChecksum(data, size) != header.checksum)
+        throw std::runtime_error("model file checksum mismatch");
+
+    if (header.layerCount < 1)
+        throw std::runtime_error("model file has an invalid layer table");
+
+    // Mapped weights are shared read-only pages; the model never writes them.
+    bool shared = mapping && header.scalarSize == sizeof(T);
+
+    BasicModel<T> model;
+
+    model.w.reserve(header.layerCount);
+
+    for (uint i = 0; i < header.layerCount; i++) {
+        FileLayer layer;
+        memcpy(&layer, data + sizeof(header) + i * sizeof(layer), sizeof(layer));
+
+        uint64_t bytes = (uint64_t)layer.height * layer.width * header.scalarSize;
+
+        if (layer.height == 0 || layer.width == 0 || layer.offset % Alignment != 0 || layer.offset + bytes > size ||
+            (i > 0 && layer.height != model.w.back().width() + 1u))
+            throw std::runtime_error("model file has an invalid layer table");
+
+        if (shared)
+            model.w.push_back(Matrix<T>::view((T *)(data + layer.offset), layer.height, layer.width));
+        else {
+            model.w.push_back(Matrix<T>(layer.height, layer.width, Matrix<T>::Padded));
+
+            if (header.scalarSize == sizeof(float))
+                convert<float>(data + layer.offset, model.w.back());
+            else
+                convert<double>(data + layer.offset, model.w.back());
+        }
+    }
+
+    if (shared)
+        model.mapping = mapping;
+
+    return model;
+}
+
+template <class T>
+BasicModel<T>::BasicModel()
+    : fastMath(false) {
+}
+
+template <class T>
+BasicModel<T>::BasicModel(const std::vector<Matrix<T>> &w)
+    : w(w), fastMath(false) {
+}
+
+template <class T>
+template <class U>
+BasicModel<T>::BasicModel(const BasicModel<U> &model)
+    : fastMath(model.fastMath) {
+    w.reserve(model.w.size());
+
+    for (uint i = 0; i < model.w.size(); i++)
+        w.push_back(Matrix<T>(model.w[i]));
+}
+
+template <class T>
+std::vector<int> BasicModel<T>::sizes() const {
+    std::vector<int> r;
+
+    for (uint i = 0; i < w.size(); i++)
+        r.push_back(w[i].height() - 1);
+
+    if (!w.empty())
+        r.push_back(w.back().width());
+
+    return r;
+}
+
+template <class T>
+const std::vector<T> &BasicModel<T>::forward(const std::vector<T> &input, Workspace &workspace) const {
+    return forward(input.data(), workspace);
+}
+
+template <class T>
+const std::vector<T> &BasicModel<T>::forward(const T *input, Workspace &workspace) const {
+    forwardLogits(input, workspace);
+
+    std::vector<T> &out = workspace.a.back();
+
+    softmax(out.data(), out.size(), fastMath);
+
+    return out;
+}
+
+template <class T>
+void BasicModel<T>::forwardLogits(const T *input, Workspace &workspace) const {
+    if (!workspace.fits(*this))
+        workspace = Workspace(*this);
+
+    std::vector<std::vector<T>> &a = workspace.a;
+
+    std::copy(input, input + a[0].size() - 1, a[0].begin());
+
+    w[0].multiply(a[0].data(), a[1].data());
+
+    forwardHidden(workspace);
+}
+
+template <class T>
+void BasicModel<T>::forwardLogits(const SparseVector<T> &input, Workspace &workspace) const {
+    if (!workspace.fits(*this))
+        workspace = Workspace(*this);
+
+    const Matrix<T> &w0 = w[0];
+    T *a = workspace.a[1].data();
+
+    int inputs = w0.height() - 1;
+
+    std::copy(w0[inputs], w0[inputs] + w0.width(), a);
+
+    for (int k = 0; k < input.size(); k++) {
+        uint i = input.indices()[k];
+
+        if (i >= (uint)inputs)
+            throw std::runtime_error("sparse input index out of range");
+
+        kernels::axpy(w0.width(), input.values()[k], w0[i], a);
+    }
+
+    forwardHidden(workspace);
+}
+
+// Applies tanh to the first layer's sums, which must be in a[1], and runs the
+// remaining layers.
+template <class T>
+void BasicModel<T>::forwardHidden(Workspace &workspace) const {
+    std::vector<std::vector<T>> &a = workspace.a;
+
+    for (uint i = 1; i < w.size(); i++) {
+        tanh(a[i].data(), w[i - 1].width(), fastMath);
+        w[i].multiply(a[i].data(), a[i + 1].data());
+    }
+}
+
+template <class T>
+Matrix<T> BasicModel<T>::forwardBatch(const Matrix<T> &inputs) const {
+    Matrix<T> x = forwardBatchLogits(inputs);
+
+    for (int k = 0; k < x.height(); k++)
+        softmax(x[k], x.width(), fastMath);
+
+    return x;
+}
+
+template <class T>
+Matrix<T> BasicModel<T>::forwardBatchLogits(const Matrix<T> &inputs) const {
+    Matrix<T> x = inputs;
+
+    for (uint i = 0; i < w.size(); i++) {
+        Matrix<T> biased(x.height(), x.width() + 1);
+
+        for (int k = 0; k < x.height(); k++) {
+            std::copy(x[k], x[k] + x.width(), biased[k]);
+            biased[k][x.width()] = 1;
+        }
+
+        x = biased.multiply(w[i]);
+
+        if (i < w.size() - 1)
+            for (int k = 0; k < x.height(); k++)
+                tanh(x[k], x.width(), fastMath);
+    }
+
+    return x;
+}
+
+template <class T>
+const std::vector<T> &BasicModel<T>::forward(const SparseVector<T> &input, Workspace &workspace) const {
+    forwardLogits(input, workspace);
+
+    std::vector<T> &out = workspace.a.back();
+
+    softmax(out.data(), out.size(), fastMath);
+
+    return out;
+}
+
+template <class T>
+uint BasicModel<T>::predict(const SparseVector<T> &input, Workspace &workspace) const {
+    const std::vector<T> &out = forward(input, workspace);
+
+    return argmax(out.data(), out.size());
+}
+
+template <class T>
+uint BasicModel<T>::predict(const std::vector<T> &input, Workspace &workspace) const {
+    return predict(input.data(), workspace);
+}
+
+template <class T>
+uint BasicModel<T>::predict(const T *input, Workspace &workspace) const {
+    const std::vector<T> &out = forward(input, workspace);
+
+    return argmax(out.data(), out.size());
+}
+
+template <class T>
+std::vector<uint> BasicModel<T>::predictBatch(const Matrix<T> &inputs) const {
+    Matrix<T> out = forwardBatch(inputs);
+
+    std::vector<uint> r(out.height());
+
+    for (int k = 0; k < out.height(); k++)
+        r[k] = argmax(out[k], out.width());
+
+    return r;
+}
+
+template <class T>
+void BasicModel<T>::predictGrid(const Grid<T> &grid, uint *classes, ThreadPool *pool) const {
+    evaluateGrid(grid, pool, [classes](long long first, const Matrix<T> &out) {
+        for (int k = 0; k < out.height(); k++)
+            classes[first + k] = argmax(out[k], out.width());
+    });
+}
+
+template <class T>
+void BasicModel<T>::forwardGrid(const Grid<T> &grid, T *probabilities, ThreadPool *pool) const {
+    evaluateGrid(grid, pool, [probabilities](long long first, const Matrix<T> &out) {
+        for (int k = 0; k < out.height(); k++)
+            std::copy(out[k], out[k] + out.width(), probabilities + (first + k) * out.width());
+    });
+}
+
+template <class T>
+template <class F>
+void BasicModel<T>::evaluateGrid(const Grid<T> &grid, ThreadPool *pool, const F &store) const {
+    if (w.empty() || w[0].height() != 3)
+        throw std::runtime_error("grid evaluation needs a model with two inputs");
+
+    long long points = (long long)grid.columns * grid.rows;
+    long long batches = (points + GridBatch - 1) / GridBatch;
+
+    int n = pool ? pool->size() : 1;
+
+    auto work = [&](int t) {
+        Matrix<T> inputs(GridBatch, 2);
+
+        for (long long b = batches * t / n; b < batches * (t + 1) / n; b++) {
+            long long first = b * GridBatch;
+            int count = std::min<long long>(GridBatch, points - first);
+
+            if (count != inputs.height())
+                inputs = Matrix<T>(count, 2);
+
+            for (int k = 0; k < count; k++) {
+                long long p = first + k;
+
+                inputs[k][0] = grid.x0 + (p % grid.columns) * grid.dx;
+                inputs[k][1] = grid.y0 + (p / grid.columns) * grid.dy;
+            }
+
+            store(first, forwardBatch(inputs));
+        }
+    };
+
+    if (pool)
+        pool->run(work);
+    else
+        work(0);
+}
+
+template <class T>
+Evaluation BasicModel<T>::evaluate(const BasicDataset<T> &dataset, int k, ThreadPool *pool) const {
+    return evaluateDataset(dataset, k, pool);
+}
+
+template <class T>
+Evaluation BasicModel<T>::evaluate(const DatasetFile &dataset, int k, ThreadPool *pool) const {
+    return evaluateDataset(dataset, k, pool);
+}
+
+template <class T>
+template <class D>
+Evaluation BasicModel<T>::evaluateDataset(const D &dataset, int k, ThreadPool *pool) const {
+    if (w.empty() || dataset.features() != w[0].height() - 1)
+        throw std::runtime_error("evaluation data does not match the network input size");
+
+    struct Partial {
+        double lossSum, lossMax;
+        long long top1, topK;
+        std::vector<long long> confusion;
+        bool invalid;
+    };
+
+    int features = dataset.features();
+    int classes = w.back().width();
+
+    long long samples = dataset.size();
+    long long batches = (samples + EvaluationBatch - 1) / EvaluationBatch;
+
+    int n = pool ? pool->size() : 1;
+
+    std::vector<Partial> partials(n);
+
+    auto work = [&](int t) {
+        Partial &r = partials[t];
+
+        r.lossSum = r.lossMax = 0;
+        r.top1 = r.topK = 0;
+        r.confusion.assign((long long)classes * classes, 0);
+        r.invalid = false;
+
+        Matrix<T> inputs(EvaluationBatch, features);
+
+        for (long long b = batches * t / n; b < batches * (t + 1) / n; b++) {
+            long long first = b * EvaluationBatch;
+            int count = std::min<long long>(EvaluationBatch, samples - first);
+
+            if (count != inputs.height())
+                inputs = Matrix<T>(count, features);
+
+            for (int i = 0; i < count; i++)
+                std::copy(dataset.input(first + i), dataset.input(first + i) + features, inputs[i]);
+
+            Matrix<T> out = forwardBatchLogits(inputs);
+
+            for (int i = 0; i < count; i++) {
+                uint c = dataset.classIndex(first + i);
+
+                if (c >= (uint)classes) {
+                    r.invalid = true;
+                    return;
+                }
+
+                T *p = out[i];
+
+                double loss = softmaxCrossEntropy(p, classes, c, 0, fastMath);
+
+                r.lossSum += loss;
+                r.lossMax = std::max(r.lossMax, loss);
+
+                uint predicted = argmax(p, classes);
+
+                r.confusion[(long long)c * classes + predicted]++;
+
+                // Rank of the true class, breaking ties the way argmax() does.
+                int rank = 0;
+
+                for (int j = 0; j < classes; j++)
+                    rank += p[j] > p[c] || (p[j] == p[c] && j < (int)c);
+
+                r.top1 += predicted == c;
+                r.topK += rank < k;
+            }
+        }
+    };
+
+    if (pool)
+        pool->run(work);
+    else
+        work(0);
+
+    Evaluation e;
+
+    e.samples = samples;
+    e.k = k;
+    e.classes = classes;
+    e.confusion.assign((long long)classes * classes, 0);
+
+    double lossSum = 0, lossMax = 0;
+    long long top1 = 0, topK = 0;
+
+    for (const Partial &r : partials) {
+        if (r.invalid)
+            throw std::runtime_error("evaluation data has a class index the network does not output");
+
+        lossSum += r.lossSum;
+        lossMax = std::max(lossMax, r.lossMax);
+        top1 += r.top1;
+        topK += r.topK;
+
+        for (uint i = 0; i < r.confusion.size(); i++)
+            e.confusion[i] += r.confusion[i];
+    }
+
+    e.meanLoss = samples > 0 ? lossSum / samples : 0;
+    e.maxLoss = lossMax;
+    e.accuracy = samples > 0 ? (double)top1 / samples : 0;
+    e.topKAccuracy = samples > 0 ? (double)topK / samples : 0;
+
+    return e;
+}
+
+template <class T>
+void BasicModel<T>::saveToFile(const std::string &fileName) const {
+    std::vector<FileLayer> layers(w.size());
+
+    uint64_t size = align(sizeof(FileHeader) + layers.size() * sizeof(FileLayer));
+
+    for (uint i = 0; i < w.size(); i++) {
+        layers[i].height = w[i].height();
+        layers[i].width = w[i].width();
+        layers[i].offset = size;
+
+        size = align(size + (uint64_t)w[i].height() * w[i].width() * sizeof(T));
+    }
+
+    std::vector<char> data(size, 0);
+
+    if (!layers.empty())
+        memcpy(data.data() + sizeof(FileHeader), layers.data(), layers.size() * sizeof(FileLayer));
+
+    for (uint i = 0; i < w.size(); i++)
+        for (int j = 0; j < w[i].height(); j++)
+            memcpy(data.data() + layers[i].offset + (uint64_t)j * w[i].width() * sizeof(T), w[i][j], w[i].width() * sizeof(T));
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+
+    header.version = Version;
+    header.byteOrder = ByteOrder;
+    header.scalarSize = sizeof(T);
+    header.layerCount = w.size();
+    header.fileSize = size;
+    memcpy(data.data(), &header, sizeof(header));
+
+    header.checksum = fileChecksum(data.data(), size);
+
+    memcpy(data.data(), &header, sizeof(header));
+
+    std::ofstream file(fileName, std::ios::binary);
+
+    if (!file.write(data.data(), data.size()))
+        throw std::runtime_error("cannot write " + fileName);
+}
+
+template <class T>
+bool BasicModel<T>::isFastMath() const {
+    return fastMath;
+}
+
+template <class T>
+void BasicModel<T>::setFastMath(bool fastMath) {
+    this->fastMath = fastMath;
+}
+
+template <class T>
+void BasicModel<T>::tanh(T *v, int n, bool fast) {
+    if (fast) {
+        kernels::fastTanh(n, v);
+        return;
+    }
+
+    for (int j = 0; j < n; j++)
+        v[j] = ::tanh(v[j]);
+}
+
+template <class T>
+void BasicModel<T>::softmax(T *v, int n, bool fast) {
+    T max = kernels::max(n, v);
+
+    T sum = 0;
+
+    if (fast)
+        sum = kernels::fastExp(n, max, v);
+    else
+        for (int j = 0; j < n; j++)
+            sum += v[j] = exp(v[j] - max);
+
+    kernels::div(n, sum, v);
+}
+
+template <class T>
+double BasicModel<T>::softmaxCrossEntropy(T *v, int n, uint classIndex, T *g, bool fast) {
+    T max = kernels::max(n, v);
+    T logit = v[classIndex] - max;
+
+    T sum = 0;
+
+    if (fast)
+        sum = kernels::fastExp(n, max, v);
+    else
+        for (int j = 0; j < n; j++)
+            sum += v[j] = exp(v[j] - max);
+
+    kernels::div(n, sum, v);
+
+    if (g) {
+        std::copy(v, v + n, g);
+        g[classIndex] -= 1;
+    }
+
+    return log((double)sum) - logit;
+}
+
+template <class T>
+uint BasicModel<T>::argmax(const T *v, int n) {
+    T max = v[0];
+    uint iMax = 0;
+
+    for (int i = 1; i < n; i++)
+        if (max < v[i]) {
+            max = v[i];
+            iMax = i;
+        }
+
+    return iMax;
+}
+
+template <class T>
+double BasicModel<T>::gaussRandom() {
+    static double v1, v2, s;
+    static int phase = 0;
+    double x;
+
+    if (phase == 0) {
+        do {
+            double u1 = (double)rand() / RAND_MAX;
+            double u2 = (double)rand() / RAND_MAX;
+
+            v1 = 2 * u1 - 1;
+            v2 = 2 * u2 - 1;
+            s = v1 * v1 + v2 * v2;
+        } while (s >= 1 || s == 0);
+
+        x = v1 * sqrt(-2 * log(s) / s);
+    } else
+        x = v2 * sqrt(-2 * log(s) / s);
+
+    phase = 1 - phase;
+
+    return x;
+}
+
+template <class T>
+void BasicModel<T>::readMatrix(std::istream &stream, Matrix<T> &m) {
+    std::vector<double> buffer(m.width());
+
+    for (int i = 0; i < m.height(); i++) {
+        stream.read((char *)buffer.data(), buffer.size() * sizeof(double));
+        std::copy(buffer.begin(), buffer.end(), m[i]);
+    }
+}
+
+template class BasicModel<double>;
+template class BasicModel<float>;
+
+template BasicModel<double>::BasicModel(const BasicModel<float> &model);
+template BasicModel<float>::BasicModel(const BasicModel<double> &model);
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include <memory>
+
+#include "matrix.h"
+#include "sparsevector.h"
+
+typedef unsigned int uint;
+
+class MappedFile;
+class QuantizedModel;
+class ThreadPool;
+class DatasetFile;
+
+template <class T>
+class BasicDataset;
+
+// columns x rows points of a 2-D input plane; point (i, j) is
+// (x0 + i * dx, y0 + j * dy) and results are stored row by row at j * columns + i.
+template <class T>
+struct Grid {
+    T x0, y0;
+    T dx, dy;
+    int columns, rows;
+};
+
+// Results of BasicModel::evaluate(). The loss is the cross-entropy taken from
+// the logits, so it stays finite for confidently wrong predictions.
+struct Evaluation {
+    long long samples;
+
+    double meanLoss;
+    double maxLoss;
+
+    // Fractions of samples whose class is the prediction, and whose class is
+    // among the k most probable ones.
+    double accuracy;
+    double topKAccuracy;
+    int k;
+
+    // confusion[actual * classes + predicted]
+    int classes;
+    std::vector<long long> confusion;
+};
+
+template <class T>
+class BasicNetwork;
+
+template <class T, int... Sizes>
+class BasicStaticNetwork;
+
+// Weights-only inference model. All inference methods are const, so one model
+// can be shared by any number of threads as long as each of them passes its own
+// Workspace. A workspace built for the model makes forward() allocation-free.
+template <class T>
+class BasicModel {
+    template <class U>
+    friend class BasicModel;
+
+    friend class BasicNetwork<T>;
+    friend class QuantizedModel;
+
+    template <class U, int... Sizes>
+    friend class BasicStaticNetwork;
+
+public:
+    class Workspace {
+        friend class BasicModel;
+        friend class BasicNetwork<T>;
+        friend class QuantizedModel;
+
+        std::vector<std::vector<T>> a;
+
+        bool fits(const BasicModel &model) const;
+
+    public:
+        Workspace();
+        explicit Workspace(const BasicModel &model);
+
+        const std::vector<T> &output() const;
+    };
+
+    enum Verification {
+        Verify,
+        Trust
+    };
+
+private:
+    std::vector<Matrix<T>> w;
+    std::shared_ptr<const MappedFile> mapping;
+    bool fastMath;
+
+public:
+    // Reads either the current format or the legacy one (an int layer count,
+    // int sizes and unaligned doubles). Weights are converted to T as needed.
+    // Throws std::runtime_error on a damaged or unsupported file.
+    static BasicModel loadFromFile(const std::string &fileName);
+    // Maps a file in the current format and, when it stores T, runs inference
+    // straight from the mapped pages; otherwise behaves like loadFromFile().
+    // Copies of a mapped model hold their own weights; move it to keep
+    // sharing the pages. Verify reads every page once to check the checksum;
+    // Trust skips that, so mapping costs no reads up front, and only checks
+    // the header and layer table. Use it for files this process wrote or
+    // already verified.
+    static BasicModel mapFile(const std::string &fileName, Verification verification = Verify);
+
+    BasicModel();
+    explicit BasicModel(const std::vector<Matrix<T>> &w);
+
+    template <class U>
+    explicit BasicModel(const BasicModel<U> &model);
+
+    std::vector<int> sizes() const;
+
+    const std::vector<T> &forward(const std::vector<T> &input, Workspace &workspace) const;
+    const std::vector<T> &forward(const T *input, Workspace &workspace) const;
+    // Reads only the first-layer weight rows of the non-zero inputs. Throws
+    // std::runtime_error on an index past the input size.
+    const std::vector<T> &forward(const SparseVector<T> &input, Workspace &workspace) const;
+    // Each row of inputs is one sample; rows of the result match forward() bit-for-bit.
+    Matrix<T> forwardBatch(const Matrix<T> &inputs) const;
+
+    uint predict(const std::vector<T> &input, Workspace &workspace) const;
+    uint predict(const T *input, Workspace &workspace) const;
+    uint predict(const SparseVector<T> &input, Workspace &workspace) const;
+    std::vector<uint> predictBatch(const Matrix<T> &inputs) const;
+
+    // Evaluate a two-input model over a grid in batches of GridBatch points
+    // through forwardBatch(), with the batches spread over the pool's threads
+    // when one is given. predictGrid() writes one class index per point,
+    // forwardGrid() the output probabilities of every point back to back.
+    void predictGrid(const Grid<T> &grid, uint *classes, ThreadPool *pool = 0) const;
+    void forwardGrid(const Grid<T> &grid, T *probabilities, ThreadPool *pool = 0) const;
+
+    // Runs the dataset through forwardBatch() in batches of EvaluationBatch
+    // samples, spread over the pool's threads when one is given. Per-thread
+    // results are combined in thread order, so they only depend on the pool
+    // size. Throws std::runtime_error if the dataset does not fit the model.
+    Evaluation evaluate(const BasicDataset<T> &dataset, int k = 5, ThreadPool *pool = 0) const;
+    Evaluation evaluate(const DatasetFile &dataset, int k = 5, ThreadPool *pool = 0) const;
+
+    // Writes the current format: a header with magic, version, byte order mark,
+    // scalar size and checksum, a layer table, and 64-byte-aligned weight blocks
+    // stored as T.
+    void saveToFile(const std::string &fileName) const;
+
+    // Fast math evaluates tanh and the softmax exp with the vectorized
+    // approximations in kernels.h (absolute error below 1e-8 for double and
+    // 2e-7 for float) instead of the C library. Not stored in model files.
+    bool isFastMath() const;
+    void setFastMath(bool fastMath);
+
+private:
+    enum {
+        GridBatch = 256,
+        EvaluationBatch = 256
+    };
+
+    template <class F>
+    void evaluateGrid(const Grid<T> &grid, ThreadPool *pool, const F &store) const;
+    template <class D>
+    Evaluation evaluateDataset(const D &dataset, int k, ThreadPool *pool) const;
+
+    Matrix<T> forwardBatchLogits(const Matrix<T> &inputs) const;
+
+    // Leave the output layer's pre-softmax values in the workspace. The sparse
+    // version does not store the input.
+    void forwardLogits(const T *input, Workspace &workspace) const;
+    void forwardLogits(const SparseVector<T> &input, Workspace &workspace) const;
+    void forwardHidden(Workspace &workspace) const;
+
+    static void tanh(T *v, int n, bool fast = false);
+    static void softmax(T *v, int n, bool fast = false);
+    // Replaces the logits in v by the softmax, sets g to the cross-entropy
+    // gradient p - onehot(classIndex), unless g is null, and returns the loss.
+    // The loss is taken as log-sum-exp minus the logit, so it stays finite
+    // when p underflows.
+    static double softmaxCrossEntropy(T *v, int n, uint classIndex, T *g, bool fast);
+    static uint argmax(const T *v, int n);
+
+    // Standard normal values from rand() by the polar method; the second value
+    // of each pair is kept for the next call. Network and StaticNetwork both
+    // draw their initial weights from it.
+    static double gaussRandom();
+
+    static BasicModel loadLegacy(std::istream &file);
+    static BasicModel load(const char *data, std::size_t size, const std::shared_ptr<const MappedFile> &mapping, Verification verification);
+
+    static void readMatrix(std::istream &stream, Matrix<T> &m);
+};
+
+typedef BasicModel<double> Model;
+typedef BasicModel<float> FloatModel;
@@ -0,0 +1,133 @@
+#include "modelregistry.h"
+
+#include <chrono>
+
+template <class T>
+BasicModelRegistry<T>::BasicModelRegistry()
+    : serial(0), pending(false), stopping(false), collectInterval(100) {
+}
+
+template <class T>
+BasicModelRegistry<T>::BasicModelRegistry(const std::string &fileName)
+    : serial(0), pending(false), stopping(false), collectInterval(100) {
+    load(fileName);
+}
+
+template <class T>
+BasicModelRegistry<T>::~BasicModelRegistry() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_one();
+
+    if (reclaimer.joinable())
+        reclaimer.join();
+}
+
+template <class T>
+std::shared_ptr<const BasicModel<T>> BasicModelRegistry<T>::current() const {
+    return model.load();
+}
+
+template <class T>
+long long BasicModelRegistry<T>::version() const {
+    return serial.load(std::memory_order_acquire);
+}
+
+template <class T>
+void BasicModelRegistry<T>::load(const std::string &fileName) {
+    publish(BasicModel<T>::loadFromFile(fileName));
+}
+
+template <class T>
+void BasicModelRegistry<T>::map(const std::string &fileName, typename BasicModel<T>::Verification verification) {
+    publish(BasicModel<T>::mapFile(fileName, verification));
+}
+
+template <class T>
+std::future<void> BasicModelRegistry<T>::loadInBackground(const std::string &fileName) {
+    return std::async(std::launch::async, [this, fileName]() { load(fileName); });
+}
+
+template <class T>
+void BasicModelRegistry<T>::publish(const BasicModel<T> &model) {
+    publish(std::make_shared<const BasicModel<T>>(model));
+}
+
+template <class T>
+void BasicModelRegistry<T>::publish(BasicModel<T> &&model) {
+    publish(std::make_shared<const BasicModel<T>>(std::move(model)));
+}
+
+template <class T>
+void BasicModelRegistry<T>::publish(const std::shared_ptr<const BasicModel<T>> &model) {
+    this->model.store(model);
+    serial.fetch_add(1, std::memory_order_release);
+
+    if (collect() == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = true;
+
+        if (!reclaimer.joinable())
+            reclaimer = std::thread(&BasicModelRegistry::reclaim, this);
+    }
+
+    wake.notify_one();
+}
+
+template <class T>
+int BasicModelRegistry<T>::collect() {
+    return model.collect();
+}
+
+template <class T>
+int BasicModelRegistry<T>::getCollectInterval() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return collectInterval;
+}
+
+template <class T>
+void BasicModelRegistry<T>::setCollectInterval(int collectInterval) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->collectInterval = collectInterval;
+}
+
+template <class T>
+uint BasicModelRegistry<T>::predict(const T *input, typename BasicModel<T>::Workspace &workspace) const {
+    return current()->predict(input, workspace);
+}
+
+template <class T>
+void BasicModelRegistry<T>::reclaim() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!stopping) {
+        if (!pending) {
+            wake.wait(lock);
+            continue;
+        }
+
+        wake.wait_for(lock, std::chrono::milliseconds(collectInterval));
+
+        if (stopping)
+            break;
+
+        // A publish while collecting sets it again.
+        pending = false;
+
+        lock.unlock();
+        int inUse = collect();
+        lock.lock();
+
+        if (inUse > 0)
+            pending = true;
+    }
+}
+
+template class BasicModelRegistry<double>;
+template class BasicModelRegistry<float>;
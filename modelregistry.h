@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "model.h"
+#include "publishedptr.h"
+
+// Holds the model a long-running process serves and lets it be replaced while
+// requests are in flight. A new model is loaded off to the side and published
+// with one atomic pointer swap; readers never lock, see PublishedPtr. A request
+// that took the previous model with current() finishes on it, and the previous
+// model is destroyed once the last such request has let go of it.
+//
+// Replaced models are kept on a retired list and freed by the registry, never
+// by a reader dropping its reference, so request latency does not include
+// tearing down a model. Each publish frees what it can; while models remain
+// retired, a reclaimer thread retries every getCollectInterval() milliseconds,
+// so a replaced model goes at most that long after its last request ends.
+template <class T>
+class BasicModelRegistry {
+    PublishedPtr<const BasicModel<T>> model;
+    std::atomic<long long> serial;
+
+    // Started by the first publish that leaves a model retired.
+    std::thread reclaimer;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool pending;
+    bool stopping;
+    int collectInterval;
+
+public:
+    BasicModelRegistry();
+    explicit BasicModelRegistry(const std::string &fileName);
+    ~BasicModelRegistry();
+
+    BasicModelRegistry(const BasicModelRegistry &) = delete;
+    BasicModelRegistry &operator=(const BasicModelRegistry &) = delete;
+
+    // The model to serve the next request with; null until one is published.
+    // Hold on to the pointer for the whole request.
+    std::shared_ptr<const BasicModel<T>> current() const;
+    // Incremented by every publish.
+    long long version() const;
+
+    // Reads the file with BasicModel::loadFromFile() and publishes it. Throws
+    // std::runtime_error, leaving the current model in place, if the file
+    // cannot be loaded.
+    void load(const std::string &fileName);
+    // Like load() with BasicModel::mapFile(). The file must not be modified
+    // in place while mapped; write the new model elsewhere and rename it.
+    void map(const std::string &fileName, typename BasicModel<T>::Verification verification = BasicModel<T>::Verify);
+    // Runs load() on a new thread. The future rethrows load errors; like every
+    // std::async future, its destructor waits for the load to finish.
+    std::future<void> loadInBackground(const std::string &fileName);
+
+    void publish(const BasicModel<T> &model);
+    void publish(BasicModel<T> &&model);
+
+    // Frees retired models that no request holds any more. Returns how many
+    // are still in use. Only needed to free them sooner than the reclaimer.
+    int collect();
+
+    int getCollectInterval() const;
+    void setCollectInterval(int collectInterval);
+
+    // Same as current()->predict().
+    uint predict(const T *input, typename BasicModel<T>::Workspace &workspace) const;
+
+private:
+    void publish(const std::shared_ptr<const BasicModel<T>> &model);
+    void reclaim();
+};
+
+typedef BasicModelRegistry<double> ModelRegistry;
+typedef BasicModelRegistry<float> FloatModelRegistry;
@@ -1,99 +1,239 @@
 #include "network.h"
+#include "allocations.h"
 
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
 #include <algorithm>
-#include <fstream>
+#include <stdexcept>
 
-Network::Example::Example(const std::vector<double> &input, uint classIndex)
+namespace {
+typedef Telemetry::Clock Clock;
+
+double span(Telemetry &telemetry, int thread, Telemetry::Phase phase, int epoch, Clock::time_point begin, Clock::time_point end) {
+    telemetry.record(thread, phase, epoch, begin, end);
+
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+// Tells the telemetry, if any, that train() is running for the guard's lifetime.
+struct TrainingGuard {
+    Telemetry *telemetry;
+
+    explicit TrainingGuard(Telemetry *telemetry)
+        : telemetry(telemetry) {
+        if (telemetry)
+            telemetry->setTraining(true);
+    }
+
+    ~TrainingGuard() {
+        if (telemetry)
+            telemetry->setTraining(false);
+    }
+};
+}
+
+template <class T>
+BasicNetwork<T>::Example::Example(const std::vector<T> &input, uint classIndex)
     : in(input), ci(classIndex) {
 }
 
-const std::vector<double> &Network::Example::input() const {
+template <class T>
+const std::vector<T> &BasicNetwork<T>::Example::input() const {
     return in;
 }
 
-uint Network::Example::classIndex() const {
+template <class T>
+uint BasicNetwork<T>::Example::classIndex() const {
     return ci;
 }
 
-Network Network::loadFromFile(const std::string &fileName) {
-    std::ifstream file(fileName, std::ios::binary);
-
-    int size;
-    std::vector<int> sizes;
+template <class T>
+ExampleView<T> BasicNetwork<T>::Example::view() const {
+    return ExampleView<T>(in.data(), in.size(), ci);
+}
 
-    file.read((char *)&size, sizeof(int));
+template <class T>
+BasicNetwork<T>::Batch::Batch()
+    : count(0) {
+}
 
-    sizes.resize(size);
+template <class T>
+BasicNetwork<T>::Counters::Counters()
+    : samples(0), lossSum(0), lossMax(0), forward(0), backward(0), update(0), gradientSquares(0), steps(0) {
+}
 
-    file.read((char *)&sizes[0], sizeof(int) * size);
+template <class T>
+BasicNetwork<T> BasicNetwork<T>::loadFromFile(const std::string &fileName) {
+    BasicModel<T> model = BasicModel<T>::loadFromFile(fileName);
 
-    Network net(sizes);
+    BasicNetwork<T> net(model.sizes());
 
-    for (uint i = 0; i < net.w.size(); i++)
-        file.read((char *)net.w[i][0], net.w[i].height() * net.w[i].width() * sizeof(double));
+    net.model = std::move(model);
 
     return net;
 }
 
-Network::Network() {
+template <class T>
+BasicNetwork<T>::BasicNetwork()
+    : settled(0), lazy(false), denseBatch(false) {
 }
 
-Network::Network(const std::vector<int> &sizes) {
-    a.resize(sizes.size());
-    g.resize(sizes.size() - 1);
-
-    w.reserve(sizes.size() - 1);
-    gsum.reserve(sizes.size() - 1);
+template <class T>
+BasicNetwork<T>::BasicNetwork(const std::vector<int> &sizes) {
+    model.w.reserve(sizes.size() - 1);
     dw.reserve(sizes.size() - 1);
 
     for (uint i = 0; i < sizes.size() - 1; i++) {
-        Matrix<double> m(sizes[i] + 1, sizes[i + 1]);
+        Matrix<T> m(sizes[i] + 1, sizes[i + 1], Matrix<T>::Padded);
 
-        w.push_back(m);
-        gsum.push_back(m);
+        model.w.push_back(m);
         dw.push_back(m);
     }
 
+    workspace = typename BasicModel<T>::Workspace(model);
+    resizeGradients(g);
+
+    optimizer = std::make_shared<MomentumOptimizer>();
+
     defaults();
     init();
 }
 
-Network::Network(const Network &net) {
+template <class T>
+BasicNetwork<T>::~BasicNetwork() {
+    if (telemetry)
+        telemetry->detach(this);
+}
+
+template <class T>
+BasicNetwork<T>::BasicNetwork(const BasicNetwork<T> &net) {
     *this = net;
 }
 
-Network::Network(Network &&net) {
+template <class T>
+BasicNetwork<T>::BasicNetwork(BasicNetwork<T> &&net) {
     *this = std::move(net);
 }
 
-Network &Network::operator=(const Network &net) {
-    w = net.w;
-    gsum = net.gsum;
+template <class T>
+template <class U>
+BasicNetwork<T>::BasicNetwork(const BasicNetwork<U> &net)
+    : model(net.model), workspace(model) {
+    resizeGradients(g);
+
+    for (uint i = 0; i < net.dw.size(); i++)
+        dw.push_back(Matrix<T>(net.dw[i]));
+
+    state.resize(net.state.size());
+
+    for (uint i = 0; i < net.state.size(); i++)
+        for (uint k = 0; k < net.state[i].size(); k++)
+            state[i].push_back(Matrix<T>(net.state[i][k]));
+
+    for (uint i = 0; i < net.batch.a.size(); i++) {
+        batch.a.push_back(Matrix<T>(net.batch.a[i]));
+        batch.g.push_back(Matrix<T>(net.batch.g[i]));
+    }
+
+    batch.count = net.batch.count;
+
+    optimizer = net.optimizer;
+    step = net.step;
+
+    rowStep = net.rowStep;
+    touched = net.touched;
+    touched.reserve(rowStep.size());
+    marked = net.marked;
+    settled = net.settled;
+    lazy = net.lazy;
+    denseBatch = net.denseBatch;
+
+    // Skipped rows are caught up with the settings they were skipped under,
+    // before defaults() replaces them.
+    learningRate = net.learningRate;
+    momentum = net.momentum;
+    l2Decay = net.l2Decay;
+    batchSize = net.batchSize;
+
+    catchUp();
+
+    defaults();
+}
+
+template <class T>
+BasicNetwork<T> &BasicNetwork<T>::operator=(const BasicNetwork<T> &net) {
+    model = net.model;
+    workspace = net.workspace;
     dw = net.dw;
-    a = net.a;
+    state = net.state;
     g = net.g;
+    batch = net.batch;
+    optimizer = net.optimizer;
+    step = net.step;
+
+    rowStep = net.rowStep;
+    touched = net.touched;
+    touched.reserve(rowStep.size());
+    marked = net.marked;
+    settled = net.settled;
+    lazy = net.lazy;
+    denseBatch = net.denseBatch;
+
+    // Skipped rows are caught up with the settings they were skipped under,
+    // before defaults() replaces them.
+    learningRate = net.learningRate;
+    momentum = net.momentum;
+    l2Decay = net.l2Decay;
+    batchSize = net.batchSize;
+
+    catchUp();
+
+    pool.reset();
+    workers.clear();
 
     defaults();
 
     return *this;
 }
 
-Network &Network::operator=(Network &&net) {
-    w = std::move(net.w);
-    gsum = std::move(net.gsum);
+template <class T>
+BasicNetwork<T> &BasicNetwork<T>::operator=(BasicNetwork<T> &&net) {
+    model = std::move(net.model);
+    workspace = std::move(net.workspace);
     dw = std::move(net.dw);
-    a = std::move(net.a);
+    state = std::move(net.state);
     g = std::move(net.g);
+    batch = std::move(net.batch);
+    optimizer = std::move(net.optimizer);
+    step = net.step;
+
+    rowStep = std::move(net.rowStep);
+    touched = std::move(net.touched);
+    marked = std::move(net.marked);
+    settled = net.settled;
+    lazy = net.lazy;
+    denseBatch = net.denseBatch;
+
+    // Skipped rows are caught up with the settings they were skipped under,
+    // before defaults() replaces them.
+    learningRate = net.learningRate;
+    momentum = net.momentum;
+    l2Decay = net.l2Decay;
+    batchSize = net.batchSize;
+
+    catchUp();
+
+    pool.reset();
+    workers.clear();
 
     defaults();
 
     return *this;
 }
 
-void Network::defaults() {
+template <class T>
+void BasicNetwork<T>::defaults() {
     learningRate = 0.01;
     momentum = 0.1;
     l2Decay = 0.001;
@@ -101,237 +241,1028 @@ void Network::defaults() {
 
     batchSize = 1;
     maxEpochs = 1000;
+    threadCount = 1;
+    chunkSize = 4096;
+    seed = 1;
 
+    shuffle = true;
     verbose = true;
 
+    if (telemetry)
+        telemetry->detach(this);
+
+    telemetry.reset();
+
+    validationSet.reset();
+    validationInterval = 1;
+    patience = 5;
+
     counter = 0;
+    counters = Counters();
+    epoch = 0;
 }
 
-void Network::init() {
+template <class T>
+void BasicNetwork<T>::init() {
+    std::vector<Matrix<T>> &w = model.w;
+
     for (uint i = 0; i < w.size(); i++) {
         double scale = 1.0 / sqrt(w[i].height() * w[i].width());
 
         for (int j = 0; j < w[i].height(); j++)
-            for (int k = 0; k < w[i].width(); k++) {
-                w[i][j][k] = j < w[i].height() - 1 ? gaussRandom(0, scale) : 0;
-                gsum[i][j][k] = 0;
-                dw[i][j][k] = 0;
-            }
+            for (int k = 0; k < w[i].width(); k++)
+                w[i][j][k] = j < w[i].height() - 1 ? BasicModel<T>::gaussRandom() * scale : 0;
+
+        dw[i].fill(0);
     }
+
+    resetState();
 }
 
-std::vector<double> Network::forward(const std::vector<double> &input) {
-    a[0] = input;
+template <class T>
+void BasicNetwork<T>::accumulate(const typename BasicModel<T>::Workspace &workspace, const std::vector<std::vector<T>> &g, Batch &batch, std::vector<Matrix<T>> &dw) const {
+    const std::vector<std::vector<T>> &a = workspace.a;
 
-    for (uint i = 0; i < w.size(); i++) {
-        a[i].push_back(1);
+    for (uint i = 0; i < batch.a.size(); i++) {
+        std::copy(a[i].begin(), a[i].end(), batch.a[i][batch.count]);
+        std::copy(g[i].begin(), g[i].begin() + batch.g[i].width(), batch.g[i][batch.count]);
+    }
+
+    if (++batch.count == batch.a[0].height())
+        flush(batch, dw);
+}
+
+template <class T>
+void BasicNetwork<T>::flush(Batch &batch, std::vector<Matrix<T>> &dw) const {
+    for (uint i = 0; i < dw.size(); i++)
+        dw[i].addTransposedProduct(batch.a[i], batch.g[i], batch.count);
+
+    batch.count = 0;
+}
+
+template <class T>
+void BasicNetwork<T>::resizeBatch(Batch &batch, int size, std::vector<Matrix<T>> &dw) const {
+    if (!batch.a.empty() && batch.a[0].height() == size)
+        return;
+
+    if (batch.count > 0)
+        flush(batch, dw);
+
+    batch.a.clear();
+    batch.g.clear();
 
-        a[i + 1] = w[i].multiply(a[i]);
+    for (uint i = 0; i < model.w.size(); i++) {
+        batch.a.push_back(Matrix<T>(size, model.w[i].height()));
+        batch.g.push_back(Matrix<T>(size, model.w[i].width()));
+    }
+}
+
+template <class T>
+void BasicNetwork<T>::resetState() {
+    state.resize(model.w.size());
 
-        if (i < w.size() - 1)
-            tanh(a[i + 1]);
+    for (uint i = 0; i < state.size(); i++) {
+        state[i].assign(optimizer->stateSize(), Matrix<T>(model.w[i].height(), model.w[i].width(), Matrix<T>::Padded));
+
+        for (Matrix<T> &m : state[i])
+            m.fill(0);
     }
 
-    softmax(a.back());
+    step = 0;
 
-    return a.back();
+    resetLazy();
 }
 
-void Network::tanh(std::vector<double> &v) {
-    for (uint j = 0; j < v.size(); j++)
-        v[j] = ::tanh(v[j]);
+template <class T>
+void BasicNetwork<T>::resetLazy() {
+    int inputs = model.w[0].height() - 1;
+
+    rowStep.assign(inputs, 0);
+    marked.assign(inputs, 0);
+    touched.clear();
+    touched.reserve(inputs);
+
+    settled = step;
+    lazy = false;
+    denseBatch = false;
 }
 
-void Network::softmax(std::vector<double> &v) {
-    double max = v[0];
-    for (uint j = 1; j < v.size(); j++)
-        max = std::max(max, v[j]);
+// Brings every row that sparse learning skipped up to date.
+template <class T>
+void BasicNetwork<T>::catchUp() {
+    if (!lazy)
+        return;
 
-    double sum = 0;
-    for (uint j = 0; j < v.size(); j++)
-        sum += v[j] = exp(v[j] - max);
+    Matrix<T> &w = model.w[0];
+    T *s[Optimizer::MaxStateSize];
 
-    for (uint j = 0; j < v.size(); j++)
-        v[j] /= sum;
+    for (int i = 0; i < w.height() - 1; i++) {
+        for (uint k = 0; k < state[0].size(); k++)
+            s[k] = state[0][k][i];
+
+        catchUpRow(i, w[i], dw[0][i], s);
+    }
+
+    settled = step;
+    lazy = false;
 }
 
-void Network::backward(uint classIndex) {
-    g.back().resize(a.back().size());
+// Also checks the indices, so that a bad input is reported before any work
+// is done.
+template <class T>
+void BasicNetwork<T>::catchUp(const SparseVector<T> &input) {
+    Matrix<T> &w = model.w[0];
+    T *s[Optimizer::MaxStateSize];
+
+    for (int k = 0; k < input.size(); k++) {
+        uint i = input.indices()[k];
+
+        if (i >= (uint)w.height() - 1)
+            throw std::runtime_error("sparse input index out of range");
 
-    for (uint j = 0; j < a.back().size(); j++)
-        g.back()[j] = -((j == classIndex ? 1 : 0) - a.back()[j]);
+        if (!lazy)
+            continue;
+
+        for (uint j = 0; j < state[0].size(); j++)
+            s[j] = state[0][j][i];
+
+        catchUpRow(i, w[i], dw[0][i], s);
+        rowStep[i] = step;
+    }
+}
+
+// Applies the steps row i has missed to w, a copy of the row or the row
+// itself, with the matching state; dw must be zero.
+template <class T>
+void BasicNetwork<T>::catchUpRow(int row, T *w, T *dw, T *const *state) const {
+    long long steps = step - std::max(rowStep[row], settled);
+
+    if (steps <= 0)
+        return;
+
+    Optimizer::Hyperparameters h = { learningRate, momentum, l2Decay, batchSize, step };
+
+    optimizer->catchUp(model.w[0].width(), w, dw, state, steps, h);
+}
+
+template <class T>
+BasicModel<T> BasicNetwork<T>::freeze() const {
+    if (!lazy)
+        return model;
+
+    BasicModel<T> m = model;
+    Matrix<T> &w = m.w[0];
+
+    std::vector<T> zero(w.width(), 0), copy(state[0].size() * w.width());
+    T *s[Optimizer::MaxStateSize];
+
+    for (int i = 0; i < w.height() - 1; i++) {
+        for (uint k = 0; k < state[0].size(); k++) {
+            s[k] = copy.data() + k * w.width();
+            std::copy(state[0][k][i], state[0][k][i] + w.width(), s[k]);
+        }
+
+        catchUpRow(i, w[i], zero.data(), s);
+    }
+
+    return m;
+}
+
+template <class T>
+const std::vector<T> &BasicNetwork<T>::forward(const std::vector<T> &input) {
+    catchUp();
+
+    return model.forward(input, workspace);
+}
+
+template <class T>
+const std::vector<T> &BasicNetwork<T>::forward(const SparseVector<T> &input) {
+    catchUp(input);
+
+    return model.forward(input, workspace);
+}
+
+template <class T>
+Matrix<T> BasicNetwork<T>::forwardBatch(const Matrix<T> &inputs) const {
+    return lazy ? freeze().forwardBatch(inputs) : model.forwardBatch(inputs);
+}
+
+template <class T>
+double BasicNetwork<T>::forward(const T *input, uint classIndex, typename BasicModel<T>::Workspace &workspace, std::vector<std::vector<T>> &g) const {
+    model.forwardLogits(input, workspace);
+
+    std::vector<T> &out = workspace.a.back();
+
+    return BasicModel<T>::softmaxCrossEntropy(out.data(), out.size(), classIndex, g.back().data(), model.fastMath);
+}
+
+template <class T>
+double BasicNetwork<T>::forward(const SparseVector<T> &input, uint classIndex, typename BasicModel<T>::Workspace &workspace, std::vector<std::vector<T>> &g) const {
+    model.forwardLogits(input, workspace);
+
+    std::vector<T> &out = workspace.a.back();
+
+    return BasicModel<T>::softmaxCrossEntropy(out.data(), out.size(), classIndex, g.back().data(), model.fastMath);
+}
+
+template <class T>
+void BasicNetwork<T>::backward(const typename BasicModel<T>::Workspace &workspace, std::vector<std::vector<T>> &g) const {
+    const std::vector<Matrix<T>> &w = model.w;
+    const std::vector<std::vector<T>> &a = workspace.a;
 
     for (int i = w.size() - 1; i >= 0; i--) {
         if (i < (int)w.size() - 1)
-            for (uint j = 0; j < g[i].size(); j++)
+            for (int j = 0; j < w[i].width(); j++)
                 g[i][j] *= 1 - a[i + 1][j] * a[i + 1][j];
 
-        if (i > 0) {
-            g[i - 1] = w[i].multiplyTransposed(g[i]);
-            g[i - 1].pop_back();
+        if (i > 0)
+            w[i].multiplyTransposed(g[i].data(), g[i - 1].data());
+    }
+}
+
+template <class T>
+void BasicNetwork<T>::resizeGradients(std::vector<std::vector<T>> &g) const {
+    g.resize(model.w.size());
+
+    for (uint i = 0; i < g.size(); i++)
+        g[i].assign(i + 1 < g.size() ? model.w[i + 1].height() : model.w[i].width(), 0);
+}
+
+template <class T>
+double BasicNetwork<T>::update(int layer, int begin, int end, Matrix<T> &dw, int count) {
+    Matrix<T> &w = model.w[layer];
+    std::vector<Matrix<T>> &state = this->state[layer];
+
+    Optimizer::Hyperparameters h = { learningRate, momentum, l2Decay, count, step };
+
+    T *s[Optimizer::MaxStateSize];
+
+    // When every matrix is packed, all weight rows of the range go to the
+    // optimizer in one call, otherwise one row at a time; the bias row is not
+    // decayed.
+    int bias = w.height() - 1, rows = std::min(end, bias) - begin;
+
+    bool packed = w.isPacked() && dw.isPacked();
+
+    for (const Matrix<T> &m : state)
+        packed = packed && m.isPacked();
+
+    // Squared norm of the averaged gradient over the range, taken before the
+    // optimizer consumes it.
+    double squares = 0;
+
+    if (telemetry && end > begin) {
+        int run = dw.isPacked() ? end - begin : 1;
+
+        for (int i = begin; i < end; i += run)
+            squares += kernels::dot(run * w.width(), dw[i], dw[i], (T)0);
+
+        squares /= (double)count * count;
+    }
+
+    for (int i = begin, run = packed ? rows : 1; i < begin + rows; i += run) {
+        for (uint k = 0; k < state.size(); k++)
+            s[k] = state[k][i];
+
+        optimizer->update(run * w.width(), w[i], dw[i], s, h);
+    }
+
+    if (end > bias) {
+        for (uint k = 0; k < state.size(); k++)
+            s[k] = state[k][bias];
+
+        h.l2Decay = 0;
+
+        optimizer->update(w.width(), w[bias], dw[bias], s, h);
+    }
+
+    return squares;
+}
+
+template <class T>
+void BasicNetwork<T>::prepareWorkers() {
+    if (threadCount > 1 && (!pool || pool->size() != threadCount)) {
+        pool.reset(new ThreadPool(threadCount));
+
+        workers.resize(threadCount);
+
+        for (Worker &worker : workers) {
+            worker.workspace = typename BasicModel<T>::Workspace(model);
+            worker.dw = dw;
+
+            resizeGradients(worker.g);
+
+            for (Matrix<T> &m : worker.dw)
+                m.fill(0);
+        }
+    }
+
+    for (Worker &worker : workers)
+        resizeBatch(worker.batch, (batchSize + threadCount - 1) / threadCount, worker.dw);
+}
+
+template <class T>
+double BasicNetwork<T>::learnBatch(const T *const *inputs, const uint *classIndices, int count) {
+    int n = pool->size();
+
+    pool->run([&](int t) {
+        NEURO_NO_ALLOCATIONS("BasicNetwork::learnBatch");
+
+        Worker &worker = workers[t];
+
+        worker.loss = worker.lossSum = 0;
+        worker.forward = worker.backward = worker.gradientSquares = 0;
+
+        Clock::time_point t0, t1, t2;
+
+        for (int k = count * t / n; k < count * (t + 1) / n; k++) {
+            if (telemetry)
+                t0 = Clock::now();
+
+            double loss = forward(inputs[k], classIndices[k], worker.workspace, worker.g);
+
+            if (telemetry)
+                t1 = Clock::now();
+
+            backward(worker.workspace, worker.g);
+            accumulate(worker.workspace, worker.g, worker.batch, worker.dw);
+
+            if (telemetry) {
+                t2 = Clock::now();
+
+                worker.forward += span(*telemetry, t, Telemetry::Forward, epoch, t0, t1);
+                worker.backward += span(*telemetry, t, Telemetry::Backward, epoch, t1, t2);
+            }
+
+            worker.loss = std::max(worker.loss, loss);
+            worker.lossSum += loss;
+        }
+
+        if (telemetry)
+            t0 = Clock::now();
+
+        flush(worker.batch, worker.dw);
+
+        if (telemetry)
+            worker.backward += span(*telemetry, t, Telemetry::Backward, epoch, t0, Clock::now());
+    });
+
+    step++;
+
+    Clock::time_point updateBegin;
+
+    if (telemetry)
+        updateBegin = Clock::now();
+
+    pool->run([&](int t) {
+        NEURO_NO_ALLOCATIONS("BasicNetwork::learnBatch");
+
+        Worker &worker = workers[t];
+
+        for (uint i = 0; i < model.w.size(); i++) {
+            Matrix<T> &sum = workers[0].dw[i];
+
+            int begin = sum.height() * t / n, end = sum.height() * (t + 1) / n;
+
+            for (int u = 1; u < n; u++)
+                for (int j = begin; j < end; j++) {
+                    kernels::add(sum.width(), workers[u].dw[i][j], sum[j]);
+                    std::fill(workers[u].dw[i][j], workers[u].dw[i][j] + sum.width(), (T)0);
+                }
+
+            worker.gradientSquares += update(i, begin, end, sum, count);
         }
+    });
 
-        dw[i] += Matrix<double>::multiply(a[i], g[i]);
+    if (telemetry)
+        counters.update += span(*telemetry, 0, Telemetry::Update, epoch, updateBegin, Clock::now());
+
+    double loss = 0;
+
+    for (int t = 0; t < n; t++) {
+        loss = std::max(loss, workers[t].loss);
+
+        counters.lossSum += workers[t].lossSum;
+        counters.forward += workers[t].forward;
+        counters.backward += workers[t].backward;
+        counters.gradientSquares += workers[t].gradientSquares;
     }
+
+    counters.samples += count;
+    counters.lossMax = std::max(counters.lossMax, loss);
+    counters.steps++;
+
+    return loss;
 }
 
-void Network::train(const std::vector<Example> &examples) {
-    std::vector<Example> ex(examples);
+template <class T>
+double BasicNetwork<T>::learnRange(const T *const *inputs, const uint *classIndices, int count) {
+    double loss = 0;
+
+    if (threadCount > 1)
+        for (int j = 0; j < count; j += batchSize)
+            loss = std::max(loss, learnBatch(inputs + j, classIndices + j, std::min(batchSize, count - j)));
+    else
+        for (int j = 0; j < count; j++)
+            loss = std::max(loss, learn(inputs[j], classIndices[j]));
+
+    return loss;
+}
 
-    for (int i = 0; i < maxEpochs; i++) {
-        // std::random_shuffle(ex.begin(), ex.end());
+template <class T>
+void BasicNetwork<T>::train(BasicDataLoader<T> &loader) {
+    if (loader.features() != model.w[0].height() - 1)
+        throw std::runtime_error("training data does not match the network input size");
 
-        double loss = 0;
+    catchUp();
+    prepareWorkers();
 
-        for (const Example &e : ex)
-            loss = std::max(loss, learn(e));
+    if (telemetry)
+        telemetry->prepare(std::max(threadCount, 1));
 
-        if (verbose)
-            std::cout << "\n" << i << ": loss = " << loss << "\n\n" << std::flush;
+    TrainingGuard guard(telemetry.get());
 
-        if (loss <= maxLoss)
-            break;
+    // Loader batches hold whole mini-batches and are large enough to keep the
+    // queue overhead small when the mini-batches are tiny.
+    int size = (63 / batchSize + 1) * batchSize;
+
+    loader.setBatchSize(size);
+    loader.setShuffle(shuffle);
+    loader.setSeed(seed);
+    loader.start(maxEpochs);
+
+    std::vector<const T *> inputs(size);
+
+    counters = Counters();
+
+    double bestLoss = HUGE_VAL;
+    int worse = 0;
+    std::vector<Matrix<T>> best;
+
+    Clock::time_point begin = Clock::now();
+
+    while (const typename BasicDataLoader<T>::Batch *batch = loader.next()) {
+        for (int k = 0; k < batch->count; k++)
+            inputs[k] = batch->inputs + k * loader.features();
+
+        epoch = batch->epoch;
+
+        learnRange(inputs.data(), batch->classIndices, batch->count);
+
+        bool last = batch->last;
+
+        loader.release();
+
+        if (last) {
+            Clock::time_point end = Clock::now();
+
+            EpochStats stats = epochStats(begin, end);
+
+            bool stop = stats.maxLoss <= maxLoss;
+
+            if (validationSet && (epoch + 1) % validationInterval == 0) {
+                Evaluation e = evaluate(*validationSet, 1);
+
+                stats.validated = true;
+                stats.validationLoss = e.meanLoss;
+                stats.validationAccuracy = e.accuracy;
+
+                if (e.meanLoss < bestLoss) {
+                    bestLoss = e.meanLoss;
+                    worse = 0;
+
+                    if (patience > 0)
+                        best = model.w;
+                } else if (patience > 0 && ++worse >= patience) {
+                    if (!best.empty())
+                        model.w = best;
+
+                    stop = true;
+                }
+            }
+
+            if (telemetry) {
+                telemetry->record(stats);
+                telemetry->record(0, Telemetry::Epoch, epoch, begin, end);
+            }
+
+            if (verbose) {
+                std::cout << epoch << ": loss = " << stats.meanLoss << ", max " << stats.maxLoss;
+
+                if (stats.validated)
+                    std::cout << ", validation loss = " << stats.validationLoss << ", accuracy " << stats.validationAccuracy;
+
+                std::cout << ", " << stats.samplesPerSecond << " samples/s\n" << std::flush;
+            }
+
+            counters = Counters();
+            begin = Clock::now();
+
+            if (stop)
+                break;
+        }
     }
+
+    loader.stop();
 }
 
-double Network::learn(const Example &e) {
-    forward(e.input());
-    backward(e.classIndex());
+template <class T>
+EpochStats BasicNetwork<T>::epochStats(Clock::time_point begin, Clock::time_point end) const {
+    EpochStats stats;
+
+    stats.epoch = epoch;
+    stats.samples = counters.samples;
+
+    stats.meanLoss = counters.samples > 0 ? counters.lossSum / counters.samples : 0;
+    stats.maxLoss = counters.lossMax;
+
+    stats.seconds = std::chrono::duration<double>(end - begin).count();
+    stats.samplesPerSecond = stats.seconds > 0 ? counters.samples / stats.seconds : 0;
+
+    stats.forwardSeconds = counters.forward;
+    stats.backwardSeconds = counters.backward;
+    stats.updateSeconds = counters.update;
+
+    stats.gradientNorm = counters.steps > 0 ? sqrt(counters.gradientSquares / counters.steps) : 0;
+
+    double squares = 0;
+
+    for (const Matrix<T> &w : model.w) {
+        int run = w.isPacked() ? w.height() : 1;
+
+        for (int i = 0; i < w.height(); i += run)
+            squares += kernels::dot(run * w.width(), w[i], w[i], (T)0);
+    }
+
+    stats.weightNorm = sqrt(squares);
+
+    stats.validated = false;
+    stats.validationLoss = 0;
+    stats.validationAccuracy = 0;
+
+    return stats;
+}
 
-    double loss = -log(a.back()[e.classIndex()]);
+template <class T>
+void BasicNetwork<T>::train(const std::vector<Example> &examples) {
+    std::vector<const T *> inputs;
+    std::vector<uint> classIndices;
 
-    if (verbose)
-        std::cout << loss << "\n" << std::flush;
+    inputs.reserve(examples.size());
+    classIndices.reserve(examples.size());
+
+    for (const Example &e : examples) {
+        inputs.push_back(e.input().data());
+        classIndices.push_back(e.classIndex());
+    }
+
+    BasicDataLoader<T> loader(inputs, classIndices, model.w[0].height() - 1);
+
+    train(loader);
+}
+
+template <class T>
+void BasicNetwork<T>::train(const DatasetFile &dataset) {
+    BasicDataLoader<T> loader(dataset);
+
+    loader.setBlockSize(chunkSize);
+
+    train(loader);
+}
+
+template <class T>
+void BasicNetwork<T>::train(const BasicDataset<T> &dataset) {
+    BasicDataLoader<T> loader(dataset);
+
+    train(loader);
+}
+
+template <class T>
+double BasicNetwork<T>::learn(const Example &e) {
+    return learn(e.input().data(), e.classIndex());
+}
+
+template <class T>
+double BasicNetwork<T>::learn(const ExampleView<T> &e) {
+    return learn(e.input(), e.classIndex());
+}
+
+template <class T>
+double BasicNetwork<T>::learn(const T *input, uint classIndex) {
+    double loss;
+
+    catchUp();
+    resizeBatch(batch, batchSize, dw);
+
+    denseBatch = true;
+
+    NEURO_NO_ALLOCATIONS("BasicNetwork::learn");
+
+    Clock::time_point t0, t1, t2;
+
+    if (telemetry)
+        t0 = Clock::now();
+
+    loss = forward(input, classIndex, workspace, g);
+
+    if (telemetry)
+        t1 = Clock::now();
+
+    backward(workspace, g);
+    accumulate(workspace, g, batch, dw);
+
+    if (telemetry) {
+        t2 = Clock::now();
+
+        counters.forward += span(*telemetry, 0, Telemetry::Forward, epoch, t0, t1);
+        counters.backward += span(*telemetry, 0, Telemetry::Backward, epoch, t1, t2);
+    }
+
+    counters.samples++;
+    counters.lossSum += loss;
+    counters.lossMax = std::max(counters.lossMax, loss);
 
     if (++counter % batchSize == 0)
-        for (uint i = 0; i < w.size(); i++)
-            for (int j = 0; j < w[i].height(); j++)
-                for (int k = 0; k < w[i].width(); k++) {
-                    gsum[i][j][k] = momentum * gsum[i][j][k] - learningRate * ((j < w[i].height() - 1 ? l2Decay : 0) * w[i][j][k] + dw[i][j][k]) / batchSize;
-                    w[i][j][k] += gsum[i][j][k];
-                    dw[i][j][k] = 0;
-                }
+        applyStep();
+
+    return loss;
+}
+
+template <class T>
+double BasicNetwork<T>::learn(const SparseVector<T> &input, uint classIndex) {
+    double loss;
+
+    catchUp(input);
+
+    NEURO_NO_ALLOCATIONS("BasicNetwork::learn");
+
+    Clock::time_point t0, t1, t2;
+
+    if (telemetry)
+        t0 = Clock::now();
+
+    loss = forward(input, classIndex, workspace, g);
+
+    if (telemetry)
+        t1 = Clock::now();
+
+    backward(workspace, g);
+
+    // The first layer's gradient is zero outside the rows of the non-zero
+    // inputs and the bias row; the other layers are added up directly rather
+    // than through the batch.
+    Matrix<T> &dw0 = dw[0];
+
+    for (int k = 0; k < input.size(); k++) {
+        uint i = input.indices()[k];
+
+        kernels::axpy(dw0.width(), input.values()[k], g[0].data(), dw0[i]);
+
+        if (!marked[i]) {
+            marked[i] = 1;
+            touched.push_back(i);
+        }
+    }
+
+    kernels::add(dw0.width(), g[0].data(), dw0[dw0.height() - 1]);
+
+    for (uint i = 1; i < dw.size(); i++)
+        dw[i].addOuterProduct(workspace.a[i].data(), g[i].data());
+
+    if (telemetry) {
+        t2 = Clock::now();
+
+        counters.forward += span(*telemetry, 0, Telemetry::Forward, epoch, t0, t1);
+        counters.backward += span(*telemetry, 0, Telemetry::Backward, epoch, t1, t2);
+    }
+
+    counters.samples++;
+    counters.lossSum += loss;
+    counters.lossMax = std::max(counters.lossMax, loss);
+
+    if (++counter % batchSize == 0)
+        applyStep();
 
     return loss;
 }
 
-uint Network::predict(const std::vector<double> &input) {
-    forward(input);
+// Ends a mini-batch of learn() calls. If all of them were sparse, only the
+// touched first-layer rows and the bias row are updated.
+template <class T>
+void BasicNetwork<T>::applyStep() {
+    Clock::time_point t0, t1, t2;
+
+    if (telemetry)
+        t0 = Clock::now();
 
-    double max = a.back()[0];
-    uint iMax = 0;
+    if (batch.count > 0)
+        flush(batch, dw);
 
-    for (uint i = 1; i < a.back().size(); i++)
-        if (max < a.back()[i]) {
-            max = a.back()[i];
-            iMax = i;
+    if (telemetry)
+        t1 = Clock::now();
+
+    step++;
+
+    if (denseBatch)
+        counters.gradientSquares += update(0, 0, dw[0].height(), dw[0], batchSize);
+    else {
+        if (!lazy) {
+            settled = step - 1;
+            lazy = true;
         }
 
-    return iMax;
+        for (uint i : touched) {
+            counters.gradientSquares += update(0, i, i + 1, dw[0], batchSize);
+            rowStep[i] = step;
+        }
+
+        counters.gradientSquares += update(0, dw[0].height() - 1, dw[0].height(), dw[0], batchSize);
+    }
+
+    for (uint i : touched)
+        marked[i] = 0;
+
+    touched.clear();
+    denseBatch = false;
+
+    for (uint i = 1; i < dw.size(); i++)
+        counters.gradientSquares += update(i, 0, dw[i].height(), dw[i], batchSize);
+
+    counters.steps++;
+
+    if (telemetry) {
+        t2 = Clock::now();
+
+        counters.backward += span(*telemetry, 0, Telemetry::Backward, epoch, t0, t1);
+        counters.update += span(*telemetry, 0, Telemetry::Update, epoch, t1, t2);
+    }
 }
 
-void Network::saveToFile(const std::string &fileName) {
-    std::ofstream file(fileName, std::ios::binary);
+template <class T>
+uint BasicNetwork<T>::predict(const std::vector<T> &input) {
+    return predict(input.data());
+}
 
-    int *buffer = new int[a.size()];
+template <class T>
+uint BasicNetwork<T>::predict(const T *input) {
+    catchUp();
 
-    buffer[0] = a.size();
+    NEURO_NO_ALLOCATIONS("BasicNetwork::predict");
 
-    file.write((char *)buffer, sizeof(int));
+    return model.predict(input, workspace);
+}
 
-    for (uint i = 0; i < a.size(); i++)
-        buffer[i] = i < a.size() - 1 ? w[i].height() - 1 : w[i - 1].width();
+template <class T>
+uint BasicNetwork<T>::predict(const SparseVector<T> &input) {
+    catchUp(input);
 
-    file.write((char *)buffer, a.size() * sizeof(int));
+    NEURO_NO_ALLOCATIONS("BasicNetwork::predict");
 
-    for (uint i = 0; i < w.size(); i++)
-        file.write((char *)w[i][0], w[i].height() * w[i].width() * sizeof(double));
+    return model.predict(input, workspace);
+}
+
+template <class T>
+std::vector<uint> BasicNetwork<T>::predictBatch(const Matrix<T> &inputs) const {
+    return lazy ? freeze().predictBatch(inputs) : model.predictBatch(inputs);
+}
 
-    delete[] buffer;
+template <class T>
+void BasicNetwork<T>::predictGrid(const Grid<T> &grid, uint *classes) {
+    catchUp();
+    prepareWorkers();
 
-    file.close();
+    model.predictGrid(grid, classes, threadCount > 1 ? pool.get() : 0);
 }
 
-double Network::getLearningRate() const {
+template <class T>
+void BasicNetwork<T>::forwardGrid(const Grid<T> &grid, T *probabilities) {
+    catchUp();
+    prepareWorkers();
+
+    model.forwardGrid(grid, probabilities, threadCount > 1 ? pool.get() : 0);
+}
+
+template <class T>
+Evaluation BasicNetwork<T>::evaluate(const BasicDataset<T> &dataset, int k) {
+    catchUp();
+    prepareWorkers();
+
+    return model.evaluate(dataset, k, threadCount > 1 ? pool.get() : 0);
+}
+
+template <class T>
+Evaluation BasicNetwork<T>::evaluate(const DatasetFile &dataset, int k) {
+    catchUp();
+    prepareWorkers();
+
+    return model.evaluate(dataset, k, threadCount > 1 ? pool.get() : 0);
+}
+
+template <class T>
+void BasicNetwork<T>::saveToFile(const std::string &fileName) const {
+    if (lazy)
+        freeze().saveToFile(fileName);
+    else
+        model.saveToFile(fileName);
+}
+
+template <class T>
+double BasicNetwork<T>::getLearningRate() const {
     return learningRate;
 }
 
-void Network::setLearningRate(double learningRate) {
+template <class T>
+void BasicNetwork<T>::setLearningRate(double learningRate) {
+    catchUp();
+
     this->learningRate = learningRate;
 }
 
-double Network::getMomentum() const {
+template <class T>
+double BasicNetwork<T>::getMomentum() const {
     return momentum;
 }
 
-void Network::setMomentum(double momentum) {
+template <class T>
+void BasicNetwork<T>::setMomentum(double momentum) {
+    catchUp();
+
     this->momentum = momentum;
 }
 
-double Network::getL2Decay() const {
+template <class T>
+double BasicNetwork<T>::getL2Decay() const {
     return l2Decay;
 }
 
-void Network::setL2Decay(double l2Decay) {
+template <class T>
+void BasicNetwork<T>::setL2Decay(double l2Decay) {
+    catchUp();
+
     this->l2Decay = l2Decay;
 }
 
-double Network::getMaxLoss() const {
+template <class T>
+double BasicNetwork<T>::getMaxLoss() const {
     return maxLoss;
 }
 
-void Network::setMaxLoss(double maxLoss) {
+template <class T>
+void BasicNetwork<T>::setMaxLoss(double maxLoss) {
     this->maxLoss = maxLoss;
 }
 
-int Network::getBatchSize() const {
+template <class T>
+int BasicNetwork<T>::getBatchSize() const {
     return batchSize;
 }
 
-void Network::setBatchSize(int batchSize) {
+template <class T>
+void BasicNetwork<T>::setBatchSize(int batchSize) {
+    catchUp();
+
     this->batchSize = batchSize;
 }
 
-int Network::getMaxEpochs() const {
+template <class T>
+int BasicNetwork<T>::getMaxEpochs() const {
     return maxEpochs;
 }
 
-void Network::setMaxEpochs(int maxEpochs) {
+template <class T>
+void BasicNetwork<T>::setMaxEpochs(int maxEpochs) {
     this->maxEpochs = maxEpochs;
 }
 
-bool Network::isVerbose() const {
+template <class T>
+const Optimizer &BasicNetwork<T>::getOptimizer() const {
+    return *optimizer;
+}
+
+template <class T>
+void BasicNetwork<T>::setOptimizer(const Optimizer &optimizer) {
+    catchUp();
+
+    this->optimizer.reset(optimizer.clone());
+
+    resetState();
+}
+
+template <class T>
+int BasicNetwork<T>::getThreadCount() const {
+    return threadCount;
+}
+
+template <class T>
+void BasicNetwork<T>::setThreadCount(int threadCount) {
+    this->threadCount = threadCount;
+
+    if (telemetry)
+        telemetry->prepare(std::max(threadCount, 1));
+}
+
+template <class T>
+int BasicNetwork<T>::getChunkSize() const {
+    return chunkSize;
+}
+
+template <class T>
+void BasicNetwork<T>::setChunkSize(int chunkSize) {
+    this->chunkSize = chunkSize;
+}
+
+template <class T>
+bool BasicNetwork<T>::isShuffle() const {
+    return shuffle;
+}
+
+template <class T>
+void BasicNetwork<T>::setShuffle(bool shuffle) {
+    this->shuffle = shuffle;
+}
+
+template <class T>
+unsigned BasicNetwork<T>::getSeed() const {
+    return seed;
+}
+
+template <class T>
+void BasicNetwork<T>::setSeed(unsigned seed) {
+    this->seed = seed;
+}
+
+template <class T>
+bool BasicNetwork<T>::isVerbose() const {
     return verbose;
 }
 
-void Network::setVerbose(bool verbose) {
+template <class T>
+void BasicNetwork<T>::setVerbose(bool verbose) {
     this->verbose = verbose;
 }
 
-double Network::gaussRandom() {
-    static double v1, v2, s;
-    static int phase = 0;
-    double x;
+template <class T>
+bool BasicNetwork<T>::isFastMath() const {
+    return model.isFastMath();
+}
 
-    if (phase == 0) {
-        do {
-            double u1 = (double)rand() / RAND_MAX;
-            double u2 = (double)rand() / RAND_MAX;
+template <class T>
+void BasicNetwork<T>::setFastMath(bool fastMath) {
+    model.setFastMath(fastMath);
+}
+
+template <class T>
+std::shared_ptr<Telemetry> BasicNetwork<T>::getTelemetry() const {
+    return telemetry;
+}
 
-            v1 = 2 * u1 - 1;
-            v2 = 2 * u2 - 1;
-            s = v1 * v1 + v2 * v2;
-        } while (s >= 1 || s == 0);
+template <class T>
+void BasicNetwork<T>::setTelemetry(const std::shared_ptr<Telemetry> &telemetry) {
+    if (telemetry)
+        telemetry->attach(this);
 
-        x = v1 * sqrt(-2 * log(s) / s);
-    } else
-        x = v2 * sqrt(-2 * log(s) / s);
+    if (this->telemetry && this->telemetry != telemetry)
+        this->telemetry->detach(this);
 
-    phase = 1 - phase;
+    this->telemetry = telemetry;
+
+    // learn() records spans outside train() too.
+    if (telemetry)
+        telemetry->prepare(std::max(threadCount, 1));
+}
 
-    return x;
+template <class T>
+std::shared_ptr<const BasicDataset<T>> BasicNetwork<T>::getValidationSet() const {
+    return validationSet;
 }
 
-double Network::gaussRandom(double mu, double std) {
-    return mu + gaussRandom() * std;
+template <class T>
+void BasicNetwork<T>::setValidationSet(const std::shared_ptr<const BasicDataset<T>> &validationSet) {
+    this->validationSet = validationSet;
 }
+
+template <class T>
+int BasicNetwork<T>::getValidationInterval() const {
+    return validationInterval;
+}
+
+template <class T>
+void BasicNetwork<T>::setValidationInterval(int validationInterval) {
+    this->validationInterval = validationInterval;
+}
+
+template <class T>
+int BasicNetwork<T>::getPatience() const {
+    return patience;
+}
+
+template <class T>
+void BasicNetwork<T>::setPatience(int patience) {
+    this->patience = patience;
+}
+
+template class BasicNetwork<double>;
+template class BasicNetwork<float>;
+
+template BasicNetwork<double>::BasicNetwork(const BasicNetwork<float> &net);
+template BasicNetwork<float>::BasicNetwork(const BasicNetwork<double> &net);
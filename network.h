@@ -2,27 +2,84 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
-#include "matrix.h"
+#include "model.h"
+#include "threadpool.h"
+#include "optimizer.h"
+#include "dataloader.h"
+#include "telemetry.h"
 
-typedef unsigned int uint;
+template <class T>
+class BasicNetwork {
+    template <class U>
+    friend class BasicNetwork;
 
-class Network {
 public:
     class Example {
-        std::vector<double> in;
+        std::vector<T> in;
         uint ci;
 
     public:
-        Example(const std::vector<double> &in, uint classIndex);
+        Example(const std::vector<T> &in, uint classIndex);
 
-        const std::vector<double> &input() const;
+        const std::vector<T> &input() const;
         uint classIndex() const;
+
+        ExampleView<T> view() const;
     };
 
 private:
-    std::vector<Matrix<double>> w, gsum, dw;
-    std::vector<std::vector<double>> a, g;
+    // Activations and output gradients of samples whose weight gradients have
+    // not been added to dw yet; flush() adds them as one rank-k update per layer.
+    struct Batch {
+        std::vector<Matrix<T>> a, g;
+        int count;
+
+        Batch();
+    };
+
+    struct Worker {
+        typename BasicModel<T>::Workspace workspace;
+        std::vector<std::vector<T>> g;
+        std::vector<Matrix<T>> dw;
+        Batch batch;
+        double loss, lossSum;
+        double forward, backward, gradientSquares;
+    };
+
+    // Totals since the start of the epoch. Phase times and gradient norms are
+    // only taken while telemetry is attached.
+    struct Counters {
+        long long samples;
+        double lossSum, lossMax;
+        double forward, backward, update;
+        double gradientSquares;
+        long long steps;
+
+        Counters();
+    };
+
+    BasicModel<T> model;
+    typename BasicModel<T>::Workspace workspace;
+
+    std::vector<Matrix<T>> dw;
+    std::vector<std::vector<Matrix<T>>> state;
+    std::vector<std::vector<T>> g;
+    Batch batch;
+
+    std::shared_ptr<const Optimizer> optimizer;
+
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<Worker> workers;
+
+    std::shared_ptr<Telemetry> telemetry;
+    Counters counters;
+    int epoch;
+
+    std::shared_ptr<const BasicDataset<T>> validationSet;
+    int validationInterval;
+    int patience;
 
     double learningRate;
     double momentum;
@@ -31,39 +88,114 @@ private:
 
     int batchSize;
     int maxEpochs;
+    int threadCount;
+    int chunkSize;
+    unsigned seed;
 
+    bool shuffle;
     bool verbose;
 
     int counter;
+    long long step;
+
+    // Sparse learning updates only the first-layer rows of non-zero inputs.
+    // While lazy, row i has had the updates up to max(rowStep[i], settled)
+    // applied and is brought up to date before it is read.
+    std::vector<long long> rowStep;
+    std::vector<uint> touched;
+    std::vector<char> marked;
+    long long settled;
+    bool lazy;
+    bool denseBatch;
 
 public:
-    static Network loadFromFile(const std::string &fileName);
+    // Either precision loads files written by the other; see BasicModel.
+    static BasicNetwork loadFromFile(const std::string &fileName);
+
+    BasicNetwork();
+    BasicNetwork(const std::vector<int> &sizes);
+    ~BasicNetwork();
+    // Copies, moves and conversions take the weights and the training state;
+    // settings, telemetry and the validation set are reset by defaults(), as
+    // for a new network.
+    BasicNetwork(const BasicNetwork &net);
+    BasicNetwork(BasicNetwork &&net);
 
-    Network();
-    Network(const std::vector<int> &sizes);
-    Network(const Network &net);
-    Network(Network &&net);
+    template <class U>
+    explicit BasicNetwork(const BasicNetwork<U> &net);
 
-    Network &operator=(const Network &net);
-    Network &operator=(Network &&net);
+    BasicNetwork &operator=(const BasicNetwork &net);
+    BasicNetwork &operator=(BasicNetwork &&net);
 
     void defaults();
     void init();
 
-    std::vector<double> forward(const std::vector<double> &input);
+    BasicModel<T> freeze() const;
+
+    const std::vector<T> &forward(const std::vector<T> &input);
+    const std::vector<T> &forward(const SparseVector<T> &input);
+    // Each row of inputs is one sample; rows of the result match forward() bit-for-bit.
+    Matrix<T> forwardBatch(const Matrix<T> &inputs) const;
 
 private:
-    void tanh(std::vector<double> &v);
-    void softmax(std::vector<double> &v);
-    void backward(uint classIndex);
+    // Runs the model and leaves the output gradient in g.back(); returns the loss.
+    double forward(const T *input, uint classIndex, typename BasicModel<T>::Workspace &workspace, std::vector<std::vector<T>> &g) const;
+    double forward(const SparseVector<T> &input, uint classIndex, typename BasicModel<T>::Workspace &workspace, std::vector<std::vector<T>> &g) const;
+    void backward(const typename BasicModel<T>::Workspace &workspace, std::vector<std::vector<T>> &g) const;
+    void resizeGradients(std::vector<std::vector<T>> &g) const;
+
+    void accumulate(const typename BasicModel<T>::Workspace &workspace, const std::vector<std::vector<T>> &g, Batch &batch, std::vector<Matrix<T>> &dw) const;
+    void flush(Batch &batch, std::vector<Matrix<T>> &dw) const;
+    void resizeBatch(Batch &batch, int size, std::vector<Matrix<T>> &dw) const;
+    void resetState();
+    double update(int layer, int begin, int end, Matrix<T> &dw, int count);
+    void applyStep();
+
+    void resetLazy();
+    void catchUp();
+    void catchUp(const SparseVector<T> &input);
+    void catchUpRow(int row, T *w, T *dw, T *const *state) const;
+
+    void prepareWorkers();
+    double learnBatch(const T *const *inputs, const uint *classIndices, int count);
+    double learnRange(const T *const *inputs, const uint *classIndices, int count);
+
+    void train(BasicDataLoader<T> &loader);
+    EpochStats epochStats(Telemetry::Clock::time_point begin, Telemetry::Clock::time_point end) const;
 
 public:
+    // Training data is gathered into batches on a loader thread, reshuffled
+    // every epoch unless shuffling is off.
     void train(const std::vector<Example> &examples);
+    // Streams the dataset in chunks of getChunkSize() examples, shuffled within
+    // each chunk, so memory use does not grow with the dataset size.
+    void train(const DatasetFile &dataset);
+    void train(const BasicDataset<T> &dataset);
+
     double learn(const Example &e);
+    double learn(const ExampleView<T> &e);
+    double learn(const T *input, uint classIndex);
+    // Touches only the first-layer rows of the non-zero inputs. The other rows
+    // are brought up to date in closed form when next read, so sparse and
+    // dense learning agree up to rounding; see Optimizer::catchUp(). With
+    // Adam, and RMSProp with L2 decay, catching up costs one update per
+    // skipped step, so sparse learning saves no work there.
+    double learn(const SparseVector<T> &input, uint classIndex);
+
+    uint predict(const std::vector<T> &input);
+    uint predict(const T *input);
+    uint predict(const SparseVector<T> &input);
+    std::vector<uint> predictBatch(const Matrix<T> &inputs) const;
 
-    uint predict(const std::vector<double> &input);
+    // See BasicModel::predictGrid(); runs on getThreadCount() threads.
+    void predictGrid(const Grid<T> &grid, uint *classes);
+    void forwardGrid(const Grid<T> &grid, T *probabilities);
 
-    void saveToFile(const std::string &fileName);
+    // See BasicModel::evaluate(); runs on getThreadCount() threads.
+    Evaluation evaluate(const BasicDataset<T> &dataset, int k = 5);
+    Evaluation evaluate(const DatasetFile &dataset, int k = 5);
+
+    void saveToFile(const std::string &fileName) const;
 
     double getLearningRate() const;
     void setLearningRate(double learningRate);
@@ -83,10 +215,57 @@ public:
     int getMaxEpochs() const;
     void setMaxEpochs(int maxEpochs);
 
+    // The optimizer is cloned; changing it discards the accumulated optimizer
+    // state. Learning rate, momentum and L2 decay are still taken from the network.
+    const Optimizer &getOptimizer() const;
+    void setOptimizer(const Optimizer &optimizer);
+
+    // With more than one thread, train() splits every mini-batch across a
+    // thread pool and reduces the per-thread gradients in a fixed order, so
+    // results are reproducible for a given thread count.
+    int getThreadCount() const;
+    void setThreadCount(int threadCount);
+
+    int getChunkSize() const;
+    void setChunkSize(int chunkSize);
+
+    // Every train() call replays the same sequence of epoch permutations.
+    bool isShuffle() const;
+    void setShuffle(bool shuffle);
+
+    unsigned getSeed() const;
+    void setSeed(unsigned seed);
+
+    // Prints one line per epoch from train().
     bool isVerbose() const;
     void setVerbose(bool verbose);
 
-private:
-    double gaussRandom();
-    double gaussRandom(double mu, double std);
+    // See BasicModel::setFastMath(); applies to training and inference.
+    bool isFastMath() const;
+    void setFastMath(bool fastMath);
+
+    // Receives an EpochStats record at the end of every epoch and, if it
+    // traces, the forward, backward and update spans of every sample. Backward
+    // includes the batched weight-gradient products; update is the optimizer
+    // step plus, with several threads, the gradient reduction. Throws
+    // std::runtime_error if the telemetry is attached to another network.
+    std::shared_ptr<Telemetry> getTelemetry() const;
+    void setTelemetry(const std::shared_ptr<Telemetry> &telemetry);
+
+    // When set, train() evaluates the network on it every
+    // getValidationInterval() epochs and reports the result in EpochStats.
+    // After getPatience() evaluations in a row without a lower mean loss,
+    // training stops and the weights of the best evaluation are restored; a
+    // patience of 0 only reports.
+    std::shared_ptr<const BasicDataset<T>> getValidationSet() const;
+    void setValidationSet(const std::shared_ptr<const BasicDataset<T>> &validationSet);
+
+    int getValidationInterval() const;
+    void setValidationInterval(int validationInterval);
+
+    int getPatience() const;
+    void setPatience(int patience);
 };
+
+typedef BasicNetwork<double> Network;
+typedef BasicNetwork<float> FloatNetwork;
@@ -2,9 +2,49 @@ TEMPLATE = lib
 CONFIG += windows c++11 staticlib
 CONFIG -= app_bundle qt
 
+CONFIG(debug, debug|release): DEFINES += NEURO_COUNT_ALLOCATIONS
+
 HEADERS += \
+    aligned.h \
+    allocations.h \
+    asynctrainer.h \
+    bitmap.h \
+    dataloader.h \
+    dataset.h \
+    datasetfile.h \
+    fileformat.h \
+    imageloader.h \
+    kernels.h \
+    kernelsimpl.h \
+    mappedfile.h \
     matrix.h \
-    network.h
+    model.h \
+    modelregistry.h \
+    network.h \
+    optimizer.h \
+    publishedptr.h \
+    quantizedmodel.h \
+    sparsevector.h \
+    staticnetwork.h \
+    telemetry.h \
+    threadpool.h
 
 SOURCES += \
-    network.cpp
+    aligned.cpp \
+    allocations.cpp \
+    asynctrainer.cpp \
+    bitmap.cpp \
+    dataloader.cpp \
+    dataset.cpp \
+    datasetfile.cpp \
+    imageloader.cpp \
+    kernels.cpp \
+    mappedfile.cpp \
+    model.cpp \
+    modelregistry.cpp \
+    network.cpp \
+    optimizer.cpp \
+    quantizedmodel.cpp \
+    sparsevector.cpp \
+    telemetry.cpp \
+    threadpool.cpp
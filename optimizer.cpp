@@ -0,0 +1,250 @@
+#include "optimizer.h"
+#include "kernels.h"
+
+#include <cmath>
+
+namespace {
+template <class T>
+kernels::Step<T> step(const Optimizer::Hyperparameters &h) {
+    kernels::Step<T> s;
+
+    s.learningRate = h.learningRate;
+    s.momentum = h.momentum;
+    s.decay = h.l2Decay;
+    s.scale = (T)1 / h.count;
+    s.beta1 = 0;
+    s.beta2 = 0;
+    s.epsilon = 0;
+
+    return s;
+}
+
+// Zero-gradient momentum steps are linear in (w, v): each one multiplies the
+// pair by the same 2 x 2 matrix m, so steps of them multiply it by m^steps.
+struct Linear {
+    double m[2][2];
+
+    Linear operator*(const Linear &b) const {
+        Linear r;
+
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 2; j++)
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j];
+
+        return r;
+    }
+
+    Linear power(long long steps) const {
+        Linear r = {{{1, 0}, {0, 1}}}, p = *this;
+
+        for (; steps > 0; steps >>= 1) {
+            if (steps & 1)
+                r = r * p;
+
+            p = p * p;
+        }
+
+        return r;
+    }
+
+    template <class T>
+    void apply(int n, T *w, T *v) const {
+        for (int j = 0; j < n; j++) {
+            double wj = w[j], vj = v[j];
+
+            w[j] = m[0][0] * wj + m[0][1] * vj;
+            v[j] = m[1][0] * wj + m[1][1] * vj;
+        }
+    }
+};
+
+// Per-step decay of a weight with zero gradient, as applied by the kernels.
+double decayStep(const Optimizer::Hyperparameters &h) {
+    return h.learningRate * h.l2Decay / h.count;
+}
+}
+
+Optimizer::~Optimizer() {
+}
+
+void Optimizer::catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const {
+    replay(n, w, dw, state, steps, h);
+}
+
+void Optimizer::catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const {
+    replay(n, w, dw, state, steps, h);
+}
+
+template <class T>
+void Optimizer::replay(int n, T *w, T *dw, T *const *state, long long steps, const Hyperparameters &h) const {
+    Hyperparameters s = h;
+
+    for (s.step = h.step - steps + 1; s.step <= h.step; s.step++)
+        update(n, w, dw, state, s);
+}
+
+Optimizer *MomentumOptimizer::clone() const {
+    return new MomentumOptimizer(*this);
+}
+
+int MomentumOptimizer::stateSize() const {
+    return 1;
+}
+
+void MomentumOptimizer::update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+void MomentumOptimizer::update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+template <class T>
+void MomentumOptimizer::apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const {
+    kernels::momentum(n, w, dw, state[0], step<T>(h));
+}
+
+void MomentumOptimizer::catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const {
+    skip(n, w, dw, state, steps, h);
+}
+
+void MomentumOptimizer::catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const {
+    skip(n, w, dw, state, steps, h);
+}
+
+// v' = m v - a w, w' = w + v'.
+template <class T>
+void MomentumOptimizer::skip(int n, T *w, T *, T *const *state, long long steps, const Hyperparameters &h) const {
+    double a = decayStep(h), m = h.momentum;
+
+    Linear one = {{{1 - a, m}, {-a, m}}};
+
+    one.power(steps).apply(n, w, state[0]);
+}
+
+Optimizer *NesterovOptimizer::clone() const {
+    return new NesterovOptimizer(*this);
+}
+
+int NesterovOptimizer::stateSize() const {
+    return 1;
+}
+
+void NesterovOptimizer::update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+void NesterovOptimizer::update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+template <class T>
+void NesterovOptimizer::apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const {
+    kernels::nesterov(n, w, dw, state[0], step<T>(h));
+}
+
+void NesterovOptimizer::catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const {
+    skip(n, w, dw, state, steps, h);
+}
+
+void NesterovOptimizer::catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const {
+    skip(n, w, dw, state, steps, h);
+}
+
+// v' = m v - a w, w' = w + (1 + m) v' - m v.
+template <class T>
+void NesterovOptimizer::skip(int n, T *w, T *, T *const *state, long long steps, const Hyperparameters &h) const {
+    double a = decayStep(h), m = h.momentum;
+
+    Linear one = {{{1 - (1 + m) * a, m * m}, {-a, m}}};
+
+    one.power(steps).apply(n, w, state[0]);
+}
+
+AdamOptimizer::AdamOptimizer(double beta1, double beta2, double epsilon)
+    : beta1(beta1), beta2(beta2), epsilon(epsilon) {
+}
+
+Optimizer *AdamOptimizer::clone() const {
+    return new AdamOptimizer(*this);
+}
+
+int AdamOptimizer::stateSize() const {
+    return 2;
+}
+
+void AdamOptimizer::update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+void AdamOptimizer::update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+template <class T>
+void AdamOptimizer::apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const {
+    double c1 = 1 - pow(beta1, (double)h.step);
+    double c2 = sqrt(1 - pow(beta2, (double)h.step));
+
+    kernels::Step<T> s = step<T>(h);
+
+    s.learningRate = h.learningRate * c2 / c1;
+    s.beta1 = beta1;
+    s.beta2 = beta2;
+    s.epsilon = epsilon * c2;
+
+    kernels::adam(n, w, dw, state[0], state[1], s);
+}
+
+RMSPropOptimizer::RMSPropOptimizer(double decayRate, double epsilon)
+    : decayRate(decayRate), epsilon(epsilon) {
+}
+
+Optimizer *RMSPropOptimizer::clone() const {
+    return new RMSPropOptimizer(*this);
+}
+
+int RMSPropOptimizer::stateSize() const {
+    return 1;
+}
+
+void RMSPropOptimizer::update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+void RMSPropOptimizer::update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const {
+    apply(n, w, dw, state, h);
+}
+
+template <class T>
+void RMSPropOptimizer::apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const {
+    kernels::Step<T> s = step<T>(h);
+
+    s.beta2 = decayRate;
+    s.epsilon = epsilon;
+
+    kernels::rmsprop(n, w, dw, state[0], s);
+}
+
+void RMSPropOptimizer::catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const {
+    skip(n, w, dw, state, steps, h);
+}
+
+void RMSPropOptimizer::catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const {
+    skip(n, w, dw, state, steps, h);
+}
+
+// Without decay a zero gradient leaves the weights alone and only shrinks the
+// mean square.
+template <class T>
+void RMSPropOptimizer::skip(int n, T *w, T *dw, T *const *state, long long steps, const Hyperparameters &h) const {
+    if (h.l2Decay != 0) {
+        replay(n, w, dw, state, steps, h);
+        return;
+    }
+
+    T f = pow(decayRate, (double)steps);
+
+    for (int j = 0; j < n; j++)
+        state[0][j] *= f;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+// Update rules for BasicNetwork. An optimizer holds only its own settings; the
+// per-weight state buffers live in the network, so one optimizer can be shared
+// by networks of either precision.
+class Optimizer {
+public:
+    enum { MaxStateSize = 4 };
+
+    struct Hyperparameters {
+        double learningRate;
+        double momentum;
+        double l2Decay;
+        int count;
+        long long step;
+    };
+
+    virtual ~Optimizer();
+
+    virtual Optimizer *clone() const = 0;
+
+    // Number of state buffers, each shaped like the weights, that update() needs;
+    // at most MaxStateSize.
+    virtual int stateSize() const = 0;
+
+    // Applies one step to n contiguous weights. dw holds the gradient summed over
+    // count examples and is cleared; step counts updates from 1.
+    virtual void update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const = 0;
+    virtual void update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const = 0;
+
+    // Applies steps h.step - steps + 1 through h.step to weights whose gradient
+    // was zero in all of them; dw must be zero. Used to bring weights up to
+    // date that sparse learning skipped. The default calls update() once per
+    // step; optimizers override it where a closed form exists.
+    virtual void catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const;
+    virtual void catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const;
+
+protected:
+    template <class T>
+    void replay(int n, T *w, T *dw, T *const *state, long long steps, const Hyperparameters &h) const;
+};
+
+class MomentumOptimizer : public Optimizer {
+public:
+    Optimizer *clone() const;
+    int stateSize() const;
+
+    void update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const;
+    void update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const;
+
+    void catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const;
+    void catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const;
+
+private:
+    template <class T>
+    void apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const;
+    template <class T>
+    void skip(int n, T *w, T *dw, T *const *state, long long steps, const Hyperparameters &h) const;
+};
+
+class NesterovOptimizer : public Optimizer {
+public:
+    Optimizer *clone() const;
+    int stateSize() const;
+
+    void update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const;
+    void update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const;
+
+    void catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const;
+    void catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const;
+
+private:
+    template <class T>
+    void apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const;
+    template <class T>
+    void skip(int n, T *w, T *dw, T *const *state, long long steps, const Hyperparameters &h) const;
+};
+
+class AdamOptimizer : public Optimizer {
+    double beta1;
+    double beta2;
+    double epsilon;
+
+public:
+    AdamOptimizer(double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8);
+
+    Optimizer *clone() const;
+    int stateSize() const;
+
+    void update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const;
+    void update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const;
+
+private:
+    template <class T>
+    void apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const;
+};
+
+class RMSPropOptimizer : public Optimizer {
+    double decayRate;
+    double epsilon;
+
+public:
+    RMSPropOptimizer(double decayRate = 0.9, double epsilon = 1e-8);
+
+    Optimizer *clone() const;
+    int stateSize() const;
+
+    void update(int n, double *w, double *dw, double *const *state, const Hyperparameters &h) const;
+    void update(int n, float *w, float *dw, float *const *state, const Hyperparameters &h) const;
+
+    void catchUp(int n, double *w, double *dw, double *const *state, long long steps, const Hyperparameters &h) const;
+    void catchUp(int n, float *w, float *dw, float *const *state, long long steps, const Hyperparameters &h) const;
+
+private:
+    template <class T>
+    void apply(int n, T *w, T *dw, T *const *state, const Hyperparameters &h) const;
+    template <class T>
+    void skip(int n, T *w, T *dw, T *const *state, long long steps, const Hyperparameters &h) const;
+};
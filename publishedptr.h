@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+// A shared_ptr that one side replaces and many readers take copies of without
+// locking. The std::atomic_load() overloads for shared_ptr are not lock-free in
+// libstdc++ (they hash the address into a small pool of mutexes), so the
+// current value lives behind a raw atomic pointer and readers protect it with
+// hazard slots: a reader claims a slot, stores the pointer there, checks it is
+// still current and only then copies the shared_ptr out of it. A reader that
+// finds every slot taken, with more than SlotCount readers inside load() at
+// once or slot holders descheduled, copies the value under the writers' mutex
+// instead, so load() is lock-free only up to SlotCount concurrent readers.
+//
+// Replaced values are kept on a retired list and dropped by collect() once no
+// slot protects them and the list holds their last reference, so a reader
+// releasing its copy never destroys the value.
+template <class U>
+class PublishedPtr {
+    struct Entry {
+        std::shared_ptr<U> value;
+    };
+
+    // A cache line per slot, so readers on different cores do not contend.
+    struct Slot {
+        std::atomic<Entry *> entry;
+        char padding[64 - sizeof(std::atomic<Entry *>)];
+    };
+
+    enum { SlotCount = 64 };
+
+    std::atomic<Entry *> entry;
+    mutable Slot slots[SlotCount];
+
+    mutable std::mutex mutex;
+    std::vector<Entry *> retired;
+
+public:
+    PublishedPtr()
+        : entry(0) {
+        for (Slot &slot : slots)
+            slot.entry = 0;
+    }
+
+    // No load() may be running.
+    ~PublishedPtr() {
+        delete entry.load();
+
+        for (Entry *e : retired)
+            delete e;
+    }
+
+    PublishedPtr(const PublishedPtr &) = delete;
+    PublishedPtr &operator=(const PublishedPtr &) = delete;
+
+    // Null until the first store().
+    std::shared_ptr<U> load() const {
+        Entry *e = entry.load();
+
+        if (!e)
+            return std::shared_ptr<U>();
+
+        Slot *slot = claim(e);
+
+        // store() and collect() hold the mutex, so the current entry stays.
+        if (!slot) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return entry.load()->value;
+        }
+
+        // Once the slot holds the current entry, a later store() cannot free it.
+        for (Entry *c; (c = entry.load()) != e; e = c)
+            slot->entry.store(c);
+
+        std::shared_ptr<U> value = e->value;
+
+        slot->entry.store(0, std::memory_order_release);
+
+        return value;
+    }
+
+    void store(const std::shared_ptr<U> &value) {
+        Entry *fresh = new Entry{value};
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (Entry *previous = entry.exchange(fresh))
+            retired.push_back(previous);
+    }
+
+    // Frees retired values that neither a slot nor a reader's copy holds any
+    // more. Returns how many are still in use.
+    int collect() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::vector<Entry *> kept;
+
+        for (Entry *e : retired)
+            if (isProtected(e) || e->value.use_count() > 1)
+                kept.push_back(e);
+            else {
+                // Pairs with the release in the reader's last shared_ptr decrement.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                delete e;
+            }
+
+        retired.swap(kept);
+
+        return retired.size();
+    }
+
+private:
+    // Tries every slot once, starting from one picked by the thread; null if
+    // all of them are taken.
+    Slot *claim(Entry *e) const {
+        std::size_t first = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+        for (std::size_t i = 0; i < SlotCount; i++) {
+            Entry *expected = 0;
+            Slot &slot = slots[(first + i) % SlotCount];
+
+            if (!slot.entry.load(std::memory_order_relaxed) && slot.entry.compare_exchange_strong(expected, e))
+                return &slot;
+        }
+
+        return 0;
+    }
+
+    bool isProtected(Entry *e) const {
+        for (const Slot &slot : slots)
+            if (slot.entry.load() == e)
+                return true;
+
+        return false;
+    }
+};
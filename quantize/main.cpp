@@ -0,0 +1,102 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+
+#include "quantizedmodel.h"
+
+// Converts a model file into an int8 model file and reports how the two compare
+// on a test set.
+//
+// quantize <model> <calibration dataset> <output> [<test dataset>]
+
+namespace {
+template <class T, class F>
+double samplesPerSecond(const BasicDataset<T> &dataset, const F &forward) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (long long i = 0; i < dataset.size(); i++)
+        forward(dataset.input(i));
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return seconds > 0 ? dataset.size() / seconds : 0;
+}
+}
+
+int main(int argc, const char **argv) {
+    if (argc < 4) {
+        std::cerr << "usage: quantize <model> <calibration dataset> <output> [<test dataset>]\n";
+        return 1;
+    }
+
+    try {
+        Model model = Model::loadFromFile(argv[1]);
+        FloatModel floatModel(model);
+
+        FloatDataset calibration{DatasetFile(argv[2])};
+        DatasetFile testFile(argc > 4 ? argv[4] : argv[2]);
+        FloatDataset test(testFile);
+        // The same inputs for the double model, converted up front so the
+        // timing covers only the forward pass.
+        Dataset doubleTest(testFile);
+
+        QuantizedModel quantized = QuantizedModel::quantize(floatModel, calibration);
+        quantized.saveToFile(argv[3]);
+
+        Model::Workspace workspace;
+        QuantizedModel::Workspace quantizedWorkspace;
+
+        long long correct = 0, quantizedCorrect = 0, agree = 0;
+        double maxError = 0, totalError = 0;
+
+        for (long long i = 0; i < test.size(); i++) {
+            uint expected = model.predict(doubleTest.input(i), workspace);
+            uint actual = quantized.predict(test.input(i), quantizedWorkspace);
+
+            correct += expected == test.classIndex(i);
+            quantizedCorrect += actual == test.classIndex(i);
+            agree += expected == actual;
+
+            for (uint j = 0; j < workspace.output().size(); j++) {
+                double error = std::fabs(workspace.output()[j] - quantizedWorkspace.output()[j]);
+
+                maxError = std::max(maxError, error);
+                totalError += error;
+            }
+        }
+
+        long long weights = 0;
+        std::vector<int> sizes = model.sizes();
+
+        for (uint i = 0; i + 1 < sizes.size(); i++)
+            weights += (long long)(sizes[i] + 1) * sizes[i + 1];
+
+        double n = std::max(1LL, test.size());
+
+        std::cout << "examples:               " << test.size() << "\n";
+        std::cout << "double accuracy:        " << correct / n << "\n";
+        std::cout << "int8 accuracy:          " << quantizedCorrect / n << "\n";
+        std::cout << "top-1 agreement:        " << agree / n << "\n";
+        std::cout << "max probability error:  " << maxError << "\n";
+        std::cout << "mean probability error: " << totalError / (n * std::max<size_t>(1, workspace.output().size())) << "\n";
+        std::cout << "double weights:         " << weights * sizeof(double) << " bytes\n";
+        std::cout << "int8 weights:           " << quantized.memorySize() << " bytes\n";
+
+        FloatModel::Workspace floatWorkspace;
+
+        double doubleRate = samplesPerSecond(doubleTest, [&](const double *x) { model.forward(x, workspace); });
+        double floatRate = samplesPerSecond(test, [&](const float *x) { floatModel.forward(x, floatWorkspace); });
+        double quantizedRate = samplesPerSecond(test, [&](const float *x) { quantized.forward(x, quantizedWorkspace); });
+
+        std::cout << "double samples/s:       " << doubleRate << "\n";
+        std::cout << "float samples/s:        " << floatRate << "\n";
+        std::cout << "int8 samples/s:         " << quantizedRate << "\n";
+        std::cout << "int8 speedup vs double: " << (doubleRate > 0 ? quantizedRate / doubleRate : 0) << "x\n";
+        std::cout << "int8 speedup vs float:  " << (floatRate > 0 ? quantizedRate / floatRate : 0) << "x\n";
+    } catch (const std::exception &e) {
+        std::cerr << "quantize: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
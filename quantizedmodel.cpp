@@ -0,0 +1,378 @@
+#include "quantizedmodel.h"
+#include "fileformat.h"
+
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace fileformat;
+
+namespace {
+const char Magic[8] = {'N', 'E', 'U', 'R', 'O', 'Q', 'N', 'T'};
+
+enum {
+    Version = 1
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t layerCount;
+    uint32_t reserved0;
+    uint64_t fileSize;
+    // Covers the whole file, with this field taken as zero.
+    uint64_t checksum;
+    char reserved[24];
+};
+
+// Each layer's block holds the float scales, the int32 biases and the int8
+// weights, each starting on an aligned offset.
+struct FileLayer {
+    uint32_t inputs;
+    uint32_t outputs;
+    float inputScale;
+    int32_t inputZeroPoint;
+    uint64_t offset;
+};
+
+uint64_t fileChecksum(const char *data, std::size_t size) {
+    FileHeader header;
+    memcpy(&header, data, sizeof(header));
+    header.checksum = 0;
+
+    return checksum(data + sizeof(header), size - sizeof(header), checksum((const char *)&header, sizeof(header)));
+}
+
+int32_t clampBias(double x) {
+    return (int32_t)std::max<double>(-QuantizedModel::MaxBias, std::min<double>(QuantizedModel::MaxBias, std::round(x)));
+}
+
+uint64_t scaleOffset(const FileLayer &layer) {
+    return layer.offset;
+}
+
+uint64_t biasOffset(const FileLayer &layer) {
+    return align(scaleOffset(layer) + layer.outputs * sizeof(float));
+}
+
+uint64_t weightOffset(const FileLayer &layer) {
+    return align(biasOffset(layer) + layer.outputs * sizeof(int32_t));
+}
+
+uint64_t layerEnd(const FileLayer &layer) {
+    return align(weightOffset(layer) + (uint64_t)layer.outputs * layer.inputs);
+}
+}
+
+QuantizedModel::Workspace::Workspace() {
+}
+
+QuantizedModel::Workspace::Workspace(const QuantizedModel &model)
+    : a(model.layers.size() + 1) {
+    int inputs = 0;
+
+    for (uint i = 0; i < model.layers.size(); i++) {
+        a[i].assign(model.layers[i].inputs, 0);
+        inputs = std::max(inputs, model.layers[i].inputs);
+    }
+
+    if (!model.layers.empty())
+        a.back().assign(model.layers.back().outputs, 0);
+
+    q.assign(inputs, 0);
+    s.assign(kernels::TileRows, 0);
+}
+
+bool QuantizedModel::Workspace::fits(const QuantizedModel &model) const {
+    if (a.size() != model.layers.size() + 1 || s.size() != kernels::TileRows)
+        return false;
+
+    for (uint i = 0; i < model.layers.size(); i++)
+        if (a[i].size() != (uint)model.layers[i].inputs || q.size() < (uint)model.layers[i].inputs)
+            return false;
+
+    return a.back().size() == (uint)model.layers.back().outputs;
+}
+
+const std::vector<float> &QuantizedModel::Workspace::output() const {
+    return a.back();
+}
+
+QuantizedModel QuantizedModel::loadFromFile(const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+
+    if (!file)
+        throw std::runtime_error("cannot open " + fileName);
+
+    file.seekg(0, std::ios::end);
+
+    std::vector<char> data(file.tellg());
+
+    file.seekg(0);
+    file.read(data.data(), data.size());
+
+    FileHeader header;
+
+    if (data.size() < sizeof(header))
+        throw std::runtime_error("quantized model file is truncated");
+
+    memcpy(&header, data.data(), sizeof(header));
+
+    if (memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        throw std::runtime_error("not a quantized model file: " + fileName);
+
+    if (header.byteOrder != ByteOrder)
+        throw std::runtime_error("quantized model file has a different byte order");
+
+    if (header.version != Version)
+        throw std::runtime_error("unsupported quantized model file version");
+
+    if (header.fileSize != data.size() || data.size() % Alignment != 0 || sizeof(header) + (uint64_t)header.layerCount * sizeof(FileLayer) > data.size())
+        throw std::runtime_error("quantized model file is truncated");
+
+    if (fileChecksum(data.data(), data.size()) != header.checksum)
+        throw std::runtime_error("quantized model file checksum mismatch");
+
+    if (header.layerCount < 1)
+        throw std::runtime_error("quantized model file has an invalid layer table");
+
+    QuantizedModel model;
+
+    model.layers.resize(header.layerCount);
+
+    for (uint i = 0; i < header.layerCount; i++) {
+        FileLayer entry;
+        memcpy(&entry, data.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+
+        if (entry.inputs == 0 || entry.inputs > MaxInputs || entry.outputs == 0 || entry.offset % Alignment != 0 || layerEnd(entry) > data.size() ||
+            (i > 0 && (int)entry.inputs != model.layers[i - 1].outputs))
+            throw std::runtime_error("quantized model file has an invalid layer table");
+
+        Layer &layer = model.layers[i];
+
+        layer.inputs = entry.inputs;
+        layer.outputs = entry.outputs;
+        layer.inputScale = entry.inputScale;
+        layer.inputZeroPoint = entry.inputZeroPoint;
+
+        layer.scale.resize(layer.outputs);
+        layer.bias.resize(layer.outputs);
+        layer.w.resize((size_t)layer.outputs * layer.inputs);
+
+        memcpy(layer.scale.data(), data.data() + scaleOffset(entry), layer.scale.size() * sizeof(float));
+        memcpy(layer.bias.data(), data.data() + biasOffset(entry), layer.bias.size() * sizeof(int32_t));
+        memcpy(layer.w.data(), data.data() + weightOffset(entry), layer.w.size());
+
+        for (int32_t bias : layer.bias)
+            if (bias < -MaxBias || bias > MaxBias)
+                throw std::runtime_error("quantized model file has an invalid bias");
+    }
+
+    return model;
+}
+
+template <class T>
+QuantizedModel QuantizedModel::quantize(const BasicModel<T> &model, const BasicDataset<T> &calibration) {
+    const std::vector<Matrix<T>> &w = model.w;
+
+    std::vector<double> low(w.size(), 0), high(w.size(), 0);
+
+    typename BasicModel<T>::Workspace workspace(model);
+
+    for (long long k = 0; k < calibration.size(); k++) {
+        model.forward(calibration.input(k), workspace);
+
+        for (uint i = 0; i < w.size(); i++)
+            for (int j = 0; j < w[i].height() - 1; j++) {
+                low[i] = std::min(low[i], (double)workspace.a[i][j]);
+                high[i] = std::max(high[i], (double)workspace.a[i][j]);
+            }
+    }
+
+    QuantizedModel r;
+
+    r.layers.resize(w.size());
+
+    for (uint i = 0; i < w.size(); i++) {
+        Layer &layer = r.layers[i];
+
+        layer.inputs = w[i].height() - 1;
+        layer.outputs = w[i].width();
+
+        if (layer.inputs > MaxInputs)
+            throw std::runtime_error("layer too wide to quantize");
+
+        // The range always contains 0, so zero inputs quantize exactly.
+        double range = high[i] - low[i];
+
+        layer.inputScale = range > 0 ? range / 255 : 1;
+        layer.inputZeroPoint = std::max(-128, std::min(127, (int)std::round(-128 - low[i] / layer.inputScale)));
+
+        layer.w.resize((size_t)layer.outputs * layer.inputs);
+        layer.scale.resize(layer.outputs);
+        layer.bias.resize(layer.outputs);
+
+        for (int j = 0; j < layer.outputs; j++) {
+            double max = 0;
+
+            for (int k = 0; k < layer.inputs; k++)
+                max = std::max(max, std::fabs((double)w[i][k][j]));
+
+            double weightScale = max > 0 ? max / 127 : 1;
+
+            int64_t sum = 0;
+
+            for (int k = 0; k < layer.inputs; k++) {
+                int8_t q = std::max(-127, std::min(127, (int)std::round(w[i][k][j] / weightScale)));
+
+                layer.w[(size_t)j * layer.inputs + k] = q;
+                sum += q;
+            }
+
+            double scale = layer.inputScale * weightScale;
+
+            layer.scale[j] = scale;
+            layer.bias[j] = clampBias(w[i][layer.inputs][j] / scale - (double)layer.inputZeroPoint * sum);
+        }
+    }
+
+    return r;
+}
+
+QuantizedModel::QuantizedModel() {
+}
+
+std::vector<int> QuantizedModel::sizes() const {
+    std::vector<int> r;
+
+    for (uint i = 0; i < layers.size(); i++)
+        r.push_back(layers[i].inputs);
+
+    if (!layers.empty())
+        r.push_back(layers.back().outputs);
+
+    return r;
+}
+
+long long QuantizedModel::memorySize() const {
+    long long size = 0;
+
+    for (const Layer &layer : layers)
+        size += layer.w.size() + layer.scale.size() * sizeof(float) + layer.bias.size() * sizeof(int32_t);
+
+    return size;
+}
+
+const std::vector<float> &QuantizedModel::forward(const std::vector<float> &input, Workspace &workspace) const {
+    return forward(input.data(), workspace);
+}
+
+const std::vector<float> &QuantizedModel::forward(const float *input, Workspace &workspace) const {
+    if (!workspace.fits(*this))
+        workspace = Workspace(*this);
+
+    std::vector<std::vector<float>> &a = workspace.a;
+    int8_t *q = workspace.q.data();
+    int32_t *s = workspace.s.data();
+
+    std::copy(input, input + layers[0].inputs, a[0].begin());
+
+    for (uint i = 0; i < layers.size(); i++) {
+        const Layer &layer = layers[i];
+
+        const float *x = a[i].data();
+        float *y = a[i + 1].data();
+
+        float inverse = 1 / layer.inputScale;
+
+        for (int k = 0; k < layer.inputs; k++)
+            q[k] = std::max(-128L, std::min(127L, lrintf(x[k] * inverse) + layer.inputZeroPoint));
+
+        int j = 0;
+
+        for (; j + kernels::TileRows <= layer.outputs; j += kernels::TileRows) {
+            const int8_t *rows[kernels::TileRows];
+
+            for (int r = 0; r < kernels::TileRows; r++) {
+                rows[r] = &layer.w[(size_t)(j + r) * layer.inputs];
+                s[r] = layer.bias[j + r];
+            }
+
+            kernels::dot8x4(layer.inputs, rows, q, s);
+
+            for (int r = 0; r < kernels::TileRows; r++)
+                y[j + r] = layer.scale[j + r] * s[r];
+        }
+
+        for (; j < layer.outputs; j++)
+            y[j] = layer.scale[j] * (layer.bias[j] + kernels::dot8(layer.inputs, &layer.w[(size_t)j * layer.inputs], q));
+
+        if (i < layers.size() - 1)
+            BasicModel<float>::tanh(y, layer.outputs);
+    }
+
+    BasicModel<float>::softmax(a.back().data(), a.back().size());
+
+    return a.back();
+}
+
+uint QuantizedModel::predict(const std::vector<float> &input, Workspace &workspace) const {
+    return predict(input.data(), workspace);
+}
+
+uint QuantizedModel::predict(const float *input, Workspace &workspace) const {
+    const std::vector<float> &out = forward(input, workspace);
+
+    return BasicModel<float>::argmax(out.data(), out.size());
+}
+
+void QuantizedModel::saveToFile(const std::string &fileName) const {
+    std::vector<FileLayer> entries(layers.size());
+
+    uint64_t size = align(sizeof(FileHeader) + entries.size() * sizeof(FileLayer));
+
+    for (uint i = 0; i < layers.size(); i++) {
+        entries[i].inputs = layers[i].inputs;
+        entries[i].outputs = layers[i].outputs;
+        entries[i].inputScale = layers[i].inputScale;
+        entries[i].inputZeroPoint = layers[i].inputZeroPoint;
+        entries[i].offset = size;
+
+        size = layerEnd(entries[i]);
+    }
+
+    std::vector<char> data(size, 0);
+
+    if (!entries.empty())
+        memcpy(data.data() + sizeof(FileHeader), entries.data(), entries.size() * sizeof(FileLayer));
+
+    for (uint i = 0; i < layers.size(); i++) {
+        memcpy(data.data() + scaleOffset(entries[i]), layers[i].scale.data(), layers[i].scale.size() * sizeof(float));
+        memcpy(data.data() + biasOffset(entries[i]), layers[i].bias.data(), layers[i].bias.size() * sizeof(int32_t));
+        memcpy(data.data() + weightOffset(entries[i]), layers[i].w.data(), layers[i].w.size());
+    }
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+
+    header.version = Version;
+    header.byteOrder = ByteOrder;
+    header.layerCount = layers.size();
+    header.fileSize = size;
+    memcpy(data.data(), &header, sizeof(header));
+
+    header.checksum = fileChecksum(data.data(), size);
+
+    memcpy(data.data(), &header, sizeof(header));
+
+    std::ofstream file(fileName, std::ios::binary);
+
+    if (!file.write(data.data(), data.size()))
+        throw std::runtime_error("cannot write " + fileName);
+}
+
+template QuantizedModel QuantizedModel::quantize(const BasicModel<double> &model, const BasicDataset<double> &calibration);
+template QuantizedModel QuantizedModel::quantize(const BasicModel<float> &model, const BasicDataset<float> &calibration);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "model.h"
+#include "dataset.h"
+
+// Post-training int8 model. Weights are quantized symmetrically per output
+// channel; the input of every layer gets a scale and zero point calibrated from
+// the activation range seen on a calibration set. Dot products run on int8 with
+// int32 accumulation; tanh and softmax are computed in float. Like BasicModel,
+// inference is const and needs one Workspace per thread.
+//
+// Every product is at most 128 * 127 in magnitude and biases are clamped to
+// MaxBias, so layers of up to MaxInputs inputs cannot overflow the accumulator.
+class QuantizedModel {
+public:
+    enum {
+        MaxBias = 1 << 30,
+        MaxInputs = MaxBias / (128 * 127)
+    };
+
+    class Workspace {
+        friend class QuantizedModel;
+
+        std::vector<std::vector<float>> a;
+        std::vector<int8_t> q;
+        std::vector<int32_t> s;
+
+        bool fits(const QuantizedModel &model) const;
+
+    public:
+        Workspace();
+        explicit Workspace(const QuantizedModel &model);
+
+        const std::vector<float> &output() const;
+    };
+
+private:
+    struct Layer {
+        int inputs, outputs;
+
+        float inputScale;
+        int32_t inputZeroPoint;
+
+        // outputs rows of inputs weights, one row per output channel.
+        std::vector<int8_t> w;
+        // Converts an accumulator to a float output: inputScale * weight scale.
+        std::vector<float> scale;
+        // Bias and zero point correction in accumulator units.
+        std::vector<int32_t> bias;
+    };
+
+    std::vector<Layer> layers;
+
+public:
+    static QuantizedModel loadFromFile(const std::string &fileName);
+
+    // Runs the model over the calibration inputs to find activation ranges.
+    // Throws std::runtime_error if a layer has more than MaxInputs inputs.
+    template <class T>
+    static QuantizedModel quantize(const BasicModel<T> &model, const BasicDataset<T> &calibration);
+
+    QuantizedModel();
+
+    std::vector<int> sizes() const;
+    // Bytes taken by weights, scales and biases.
+    long long memorySize() const;
+
+    const std::vector<float> &forward(const std::vector<float> &input, Workspace &workspace) const;
+    const std::vector<float> &forward(const float *input, Workspace &workspace) const;
+
+    uint predict(const std::vector<float> &input, Workspace &workspace) const;
+    uint predict(const float *input, Workspace &workspace) const;
+
+    void saveToFile(const std::string &fileName) const;
+};
@@ -0,0 +1,47 @@
+#include "sparsevector.h"
+
+template <class T>
+SparseVector<T>::SparseVector() {
+}
+
+template <class T>
+SparseVector<T>::SparseVector(const T *input, int size) {
+    for (int i = 0; i < size; i++)
+        if (input[i] != 0)
+            add(i, input[i]);
+}
+
+template <class T>
+SparseVector<T>::SparseVector(const std::vector<T> &input)
+    : SparseVector(input.data(), input.size()) {
+}
+
+template <class T>
+void SparseVector<T>::add(uint index, T value) {
+    idx.push_back(index);
+    val.push_back(value);
+}
+
+template <class T>
+void SparseVector<T>::clear() {
+    idx.clear();
+    val.clear();
+}
+
+template <class T>
+int SparseVector<T>::size() const {
+    return idx.size();
+}
+
+template <class T>
+const uint *SparseVector<T>::indices() const {
+    return idx.data();
+}
+
+template <class T>
+const T *SparseVector<T>::values() const {
+    return val.data();
+}
+
+template class SparseVector<double>;
+template class SparseVector<float>;
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+typedef unsigned int uint;
+
+// Input given by its non-zero entries as index/value pairs; every other input
+// is 0. Indices need not be sorted but must not repeat.
+template <class T>
+class SparseVector {
+    std::vector<uint> idx;
+    std::vector<T> val;
+
+public:
+    SparseVector();
+    // Keeps the non-zero entries of a dense input.
+    SparseVector(const T *input, int size);
+    explicit SparseVector(const std::vector<T> &input);
+
+    void add(uint index, T value);
+    void clear();
+
+    // Number of entries, not the input size.
+    int size() const;
+
+    const uint *indices() const;
+    const T *values() const;
+};
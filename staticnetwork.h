@@ -0,0 +1,370 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "model.h"
+
+// Network whose layer sizes are template parameters, for models small enough
+// that Network's bookkeeping costs more than the arithmetic. Weights, momentum
+// and activations live in fixed-size arrays inside the object, and every loop
+// has a compile-time bound. Layers use the same layout as BasicModel (an
+// (inputs + 1) x outputs row-major block, bias row last), so model files are
+// interchangeable with Network's.
+//
+// learn() is plain per-sample SGD with momentum and L2 decay, the same update
+// as a Network with the default optimizer and batch size 1.
+template <class T, int... Sizes>
+class BasicStaticNetwork;
+
+namespace staticnetwork {
+template <class T, int In, int Out>
+struct Layer {
+    enum {
+        Inputs = In,
+        Outputs = Out
+    };
+
+    std::array<T, (In + 1) * Out> w, v;
+    std::array<T, Out> a;
+
+    void multiply(const T *x) {
+        for (int j = 0; j < Out; j++)
+            a[j] = w[In * Out + j];
+
+        for (int i = 0; i < In; i++)
+            for (int j = 0; j < Out; j++)
+                a[j] += x[i] * w[i * Out + j];
+    }
+
+    // gx = W g without the bias row.
+    void multiplyTransposed(const T *g, T *gx) const {
+        for (int i = 0; i < In; i++) {
+            T s = 0;
+
+            for (int j = 0; j < Out; j++)
+                s += w[i * Out + j] * g[j];
+
+            gx[i] = s;
+        }
+    }
+
+    void update(const T *x, const T *g, T learningRate, T momentum, T decay) {
+        for (int i = 0; i <= In; i++) {
+            T xi = i < In ? x[i] : 1;
+            T d = i < In ? decay : 0;
+
+            for (int j = 0; j < Out; j++) {
+                int k = i * Out + j;
+
+                v[k] = momentum * v[k] - learningRate * (d * w[k] + xi * g[j]);
+                w[k] += v[k];
+            }
+        }
+    }
+};
+
+template <class T>
+struct Settings {
+    T learningRate;
+    T momentum;
+    T l2Decay;
+    bool fastMath;
+};
+
+template <class T>
+inline T tanh(T x, bool fast) {
+    return fast ? 1 - 2 / (kernels::approximateExp(2 * x) + 1) : std::tanh(x);
+}
+
+template <class T, int... Sizes>
+struct Layers;
+
+template <class T, int In, int Out>
+struct Layers<T, In, Out> {
+    enum {
+        Outputs = Out
+    };
+
+    Layer<T, In, Out> layer;
+
+    const std::array<T, Out> &output() const {
+        return layer.a;
+    }
+
+    void forward(const T *x, bool fast) {
+        layer.multiply(x);
+        softmax(0, fast);
+    }
+
+    // Returns -log p[classIndex] as log-sum-exp minus the logit.
+    double softmax(uint classIndex, bool fast) {
+        T max = layer.a[0];
+
+        for (int j = 1; j < Out; j++)
+            max = std::max(max, layer.a[j]);
+
+        T logit = layer.a[classIndex] - max;
+        T sum = 0;
+
+        for (int j = 0; j < Out; j++)
+            sum += layer.a[j] = fast ? kernels::approximateExp(layer.a[j] - max) : std::exp(layer.a[j] - max);
+
+        for (int j = 0; j < Out; j++)
+            layer.a[j] /= sum;
+
+        return std::log((double)sum) - logit;
+    }
+
+    double learn(const T *x, uint classIndex, T *gx, const Settings<T> &s) {
+        layer.multiply(x);
+
+        double loss = softmax(classIndex, s.fastMath);
+
+        std::array<T, Out> g = layer.a;
+        g[classIndex] -= 1;
+
+        if (gx)
+            layer.multiplyTransposed(g.data(), gx);
+
+        layer.update(x, g.data(), s.learningRate, s.momentum, s.l2Decay);
+
+        return loss;
+    }
+
+    template <class F>
+    void each(F &f) {
+        f(layer);
+    }
+
+    template <class F>
+    void each(F &f) const {
+        f(layer);
+    }
+};
+
+template <class T, int In, int Out, int... Rest>
+struct Layers<T, In, Out, Rest...> {
+    typedef Layers<T, Out, Rest...> Next;
+
+    enum {
+        Outputs = Next::Outputs
+    };
+
+    Layer<T, In, Out> layer;
+    Next next;
+
+    const std::array<T, Outputs> &output() const {
+        return next.output();
+    }
+
+    void forward(const T *x, bool fast) {
+        layer.multiply(x);
+
+        for (int j = 0; j < Out; j++)
+            layer.a[j] = tanh(layer.a[j], fast);
+
+        next.forward(layer.a.data(), fast);
+    }
+
+    double learn(const T *x, uint classIndex, T *gx, const Settings<T> &s) {
+        layer.multiply(x);
+
+        for (int j = 0; j < Out; j++)
+            layer.a[j] = tanh(layer.a[j], s.fastMath);
+
+        std::array<T, Out> g;
+
+        double loss = next.learn(layer.a.data(), classIndex, g.data(), s);
+
+        for (int j = 0; j < Out; j++)
+            g[j] *= 1 - layer.a[j] * layer.a[j];
+
+        if (gx)
+            layer.multiplyTransposed(g.data(), gx);
+
+        layer.update(x, g.data(), s.learningRate, s.momentum, s.l2Decay);
+
+        return loss;
+    }
+
+    template <class F>
+    void each(F &f) {
+        f(layer);
+        next.each(f);
+    }
+
+    template <class F>
+    void each(F &f) const {
+        f(layer);
+        next.each(f);
+    }
+};
+}
+
+template <class T, int... Sizes>
+class BasicStaticNetwork {
+    static_assert(sizeof...(Sizes) >= 2, "a network needs at least an input and an output layer");
+
+    typedef staticnetwork::Layers<T, Sizes...> Layers;
+
+    enum {
+        LayerCount = sizeof...(Sizes) - 1,
+        Outputs = Layers::Outputs
+    };
+
+    Layers layers;
+    staticnetwork::Settings<T> settings;
+
+public:
+    static BasicStaticNetwork loadFromFile(const std::string &fileName) {
+        BasicStaticNetwork net;
+        net.setModel(BasicModel<T>::loadFromFile(fileName));
+        return net;
+    }
+
+    static std::vector<int> sizes() {
+        return std::vector<int>{Sizes...};
+    }
+
+    BasicStaticNetwork() {
+        settings.learningRate = 0.01;
+        settings.momentum = 0.1;
+        settings.l2Decay = 0.001;
+        settings.fastMath = false;
+
+        init();
+    }
+
+    explicit BasicStaticNetwork(const BasicModel<T> &model)
+        : BasicStaticNetwork() {
+        setModel(model);
+    }
+
+    // Same initialization as Network: Gaussian weights with standard deviation
+    // 1 / sqrt(height * width) from the same generator, zero bias, zero
+    // momentum. Built in place of a Network, it gets the same weights.
+    void init() {
+        Init init;
+        layers.each(init);
+    }
+
+    BasicModel<T> freeze() const {
+        std::vector<Matrix<T>> w;
+
+        Freeze freeze = {w};
+        layers.each(freeze);
+
+        return BasicModel<T>(w);
+    }
+
+    // Throws std::runtime_error if the model has a different topology.
+    void setModel(const BasicModel<T> &model) {
+        if (model.sizes() != sizes())
+            throw std::runtime_error("model does not match the network topology");
+
+        Load load = {model, 0};
+        layers.each(load);
+    }
+
+    const std::array<T, Outputs> &forward(const T *input) {
+        layers.forward(input, settings.fastMath);
+        return layers.output();
+    }
+
+    uint predict(const T *input) {
+        const std::array<T, Outputs> &out = forward(input);
+        return std::max_element(out.begin(), out.end()) - out.begin();
+    }
+
+    double learn(const T *input, uint classIndex) {
+        return layers.learn(input, classIndex, 0, settings);
+    }
+
+    void saveToFile(const std::string &fileName) const {
+        freeze().saveToFile(fileName);
+    }
+
+    double getLearningRate() const {
+        return settings.learningRate;
+    }
+
+    void setLearningRate(double learningRate) {
+        settings.learningRate = learningRate;
+    }
+
+    double getMomentum() const {
+        return settings.momentum;
+    }
+
+    void setMomentum(double momentum) {
+        settings.momentum = momentum;
+    }
+
+    double getL2Decay() const {
+        return settings.l2Decay;
+    }
+
+    void setL2Decay(double l2Decay) {
+        settings.l2Decay = l2Decay;
+    }
+
+    // See BasicModel::setFastMath().
+    bool isFastMath() const {
+        return settings.fastMath;
+    }
+
+    void setFastMath(bool fastMath) {
+        settings.fastMath = fastMath;
+    }
+
+private:
+    struct Init {
+        template <class L>
+        void operator()(L &layer) {
+            double scale = 1.0 / sqrt((L::Inputs + 1) * L::Outputs);
+
+            for (int k = 0; k < (L::Inputs + 1) * L::Outputs; k++)
+                layer.w[k] = k < L::Inputs * L::Outputs ? BasicModel<T>::gaussRandom() * scale : 0;
+
+            layer.v.fill(0);
+        }
+    };
+
+    struct Freeze {
+        std::vector<Matrix<T>> &w;
+
+        template <class L>
+        void operator()(const L &layer) {
+            w.push_back(Matrix<T>(L::Inputs + 1, L::Outputs, Matrix<T>::Padded));
+
+            for (int i = 0; i <= L::Inputs; i++)
+                std::copy(layer.w.begin() + i * L::Outputs, layer.w.begin() + (i + 1) * L::Outputs, w.back()[i]);
+        }
+    };
+
+    struct Load {
+        const BasicModel<T> &model;
+        int index;
+
+        template <class L>
+        void operator()(L &layer) {
+            const Matrix<T> &m = model.w[index++];
+
+            for (int i = 0; i <= L::Inputs; i++)
+                std::copy(m[i], m[i] + L::Outputs, layer.w.begin() + i * L::Outputs);
+
+            layer.v.fill(0);
+        }
+    };
+};
+
+template <int... Sizes>
+using StaticNetwork = BasicStaticNetwork<double, Sizes...>;
+
+template <int... Sizes>
+using FloatStaticNetwork = BasicStaticNetwork<float, Sizes...>;
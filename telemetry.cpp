@@ -0,0 +1,226 @@
+#include "telemetry.h"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cassert>
+
+namespace {
+enum {
+    StatsCapacity = 1024,
+    EventCapacity = 1 << 16
+};
+
+const char *PhaseNames[] = {"epoch", "forward", "backward", "update"};
+}
+
+// Single-producer single-consumer queue over a fixed array.
+template <class U>
+class Telemetry::Ring {
+    std::vector<U> items;
+    std::atomic<long long> head, tail;
+
+public:
+    explicit Ring(int capacity)
+        : items(capacity), head(0), tail(0) {
+    }
+
+    bool push(const U &item) {
+        long long t = tail.load(std::memory_order_relaxed);
+
+        if (t - head.load(std::memory_order_acquire) >= (long long)items.size())
+            return false;
+
+        items[t % items.size()] = item;
+        tail.store(t + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop(U &item) {
+        long long h = head.load(std::memory_order_relaxed);
+
+        if (tail.load(std::memory_order_acquire) == h)
+            return false;
+
+        item = items[h % items.size()];
+        head.store(h + 1, std::memory_order_release);
+
+        return true;
+    }
+};
+
+Telemetry::Telemetry(bool tracing)
+    : stats(new Ring<EpochStats>(StatsCapacity)), origin(Clock::now()), maxTraceEvents(1 << 22),
+      tracing(tracing), dropped(0), owner(0), training(false), requested(0), completed(0), stopping(false) {
+    thread = std::thread(&Telemetry::report, this);
+}
+
+Telemetry::~Telemetry() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_one();
+    thread.join();
+}
+
+void Telemetry::setCallback(const Callback &callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->callback = callback;
+}
+
+bool Telemetry::isTracing() const {
+    return tracing;
+}
+
+std::size_t Telemetry::getMaxTraceEvents() const {
+    return maxTraceEvents;
+}
+
+void Telemetry::setMaxTraceEvents(std::size_t maxTraceEvents) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->maxTraceEvents = maxTraceEvents;
+}
+
+void Telemetry::attach(const void *network) {
+    const void *expected = 0;
+
+    if (!owner.compare_exchange_strong(expected, network) && expected != network)
+        throw std::runtime_error("telemetry is already attached to another network");
+}
+
+void Telemetry::detach(const void *network) {
+    owner.compare_exchange_strong(network, 0);
+}
+
+void Telemetry::setTraining(bool training) {
+    this->training = training;
+}
+
+void Telemetry::prepare(int threadCount) {
+    assert(!training);
+
+    if (!tracing || (int)events.size() >= threadCount)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    while ((int)events.size() < threadCount)
+        events.push_back(std::unique_ptr<Ring<Event>>(new Ring<Event>(EventCapacity)));
+}
+
+void Telemetry::record(const EpochStats &stats) {
+    if (!this->stats->push(stats))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Telemetry::record(int thread, Phase phase, int epoch, Clock::time_point begin, Clock::time_point end) {
+    if (!tracing)
+        return;
+
+    Event event = {phase, epoch, begin, end};
+
+    // A thread without a ring, from a missing prepare(), loses its span
+    // rather than the process.
+    if (thread < 0 || thread >= (int)events.size() || !events[thread]->push(event))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Telemetry::flush() {
+    assert(std::this_thread::get_id() != thread.get_id());
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    long long generation = ++requested;
+
+    wake.notify_one();
+    drained.wait(lock, [this, generation]() { return completed >= generation; });
+}
+
+std::vector<EpochStats> Telemetry::history() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return epochs;
+}
+
+long long Telemetry::droppedCount() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void Telemetry::writeTrace(const std::string &fileName) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::ofstream file(fileName);
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"traceEvents\": [\n";
+
+    for (std::size_t i = 0; i < trace.size(); i++) {
+        const Event &e = trace[i].second;
+
+        long long begin = std::chrono::duration_cast<std::chrono::nanoseconds>(e.begin - origin).count();
+        long long duration = std::chrono::duration_cast<std::chrono::nanoseconds>(e.end - e.begin).count();
+
+        file << "{\"name\": \"" << PhaseNames[e.phase] << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << trace[i].first
+             << ", \"ts\": " << begin / 1000.0 << ", \"dur\": " << duration / 1000.0
+             << ", \"args\": {\"epoch\": " << e.epoch << "}}" << (i + 1 < trace.size() ? ",\n" : "\n");
+    }
+
+    file << "],\n\"displayTimeUnit\": \"ms\"}\n";
+
+    if (!file)
+        throw std::runtime_error("cannot write " + fileName);
+}
+
+void Telemetry::report() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wake.wait_for(lock, std::chrono::milliseconds(20), [this]() { return stopping || requested > completed; });
+
+        bool last = stopping;
+        long long generation = requested;
+
+        lock.unlock();
+        drain();
+        lock.lock();
+
+        completed = generation;
+        drained.notify_all();
+
+        if (last)
+            return;
+    }
+}
+
+void Telemetry::drain() {
+    std::vector<EpochStats> fresh;
+    EpochStats s;
+
+    while (stats->pop(s))
+        fresh.push_back(s);
+
+    Callback callback;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (std::size_t t = 0; t < events.size(); t++) {
+            Event e;
+
+            while (events[t]->pop(e))
+                if (trace.size() < maxTraceEvents)
+                    trace.push_back(std::make_pair((int)t, e));
+                else
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        epochs.insert(epochs.end(), fresh.begin(), fresh.end());
+        callback = this->callback;
+    }
+
+    if (callback)
+        for (const EpochStats &stats : fresh)
+            callback(stats);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+struct EpochStats {
+    int epoch;
+    long long samples;
+
+    double meanLoss;
+    double maxLoss;
+
+    double seconds;
+    double samplesPerSecond;
+
+    // Forward and backward are summed over training threads; update is wall time.
+    double forwardSeconds;
+    double backwardSeconds;
+    double updateSeconds;
+
+    // Root mean square of the per-step norms of the averaged gradient, and the
+    // norm of all weights at the end of the epoch.
+    double gradientNorm;
+    double weightNorm;
+
+    // Set on epochs that ended with a pass over the network's validation set.
+    bool validated;
+    double validationLoss;
+    double validationAccuracy;
+};
+
+// Collects training statistics without blocking the training threads. Every
+// producer writes into its own fixed-size lock-free ring; a reporter thread
+// drains the rings, keeps the history, calls the callback and builds the
+// trace. Entries that find their ring full are counted and dropped. Since each
+// ring has a single producer, a Telemetry serves one network at a time.
+class Telemetry {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(const EpochStats &)> Callback;
+
+    enum Phase {
+        Epoch,
+        Forward,
+        Backward,
+        Update
+    };
+
+private:
+    struct Event {
+        int phase;
+        int epoch;
+        Clock::time_point begin, end;
+    };
+
+    template <class U>
+    class Ring;
+
+    std::unique_ptr<Ring<EpochStats>> stats;
+    std::vector<std::unique_ptr<Ring<Event>>> events;
+
+    Clock::time_point origin;
+
+    std::vector<EpochStats> epochs;
+    std::vector<std::pair<int, Event>> trace;
+    std::size_t maxTraceEvents;
+
+    Callback callback;
+    bool tracing;
+
+    std::atomic<long long> dropped;
+
+    std::atomic<const void *> owner;
+    std::atomic<bool> training;
+
+    std::mutex mutex;
+    std::condition_variable wake, drained;
+    long long requested, completed;
+    bool stopping;
+
+    std::thread thread;
+
+public:
+    // With tracing on, every forward, backward and update span is recorded
+    // for writeTrace(); only epoch statistics are collected otherwise.
+    explicit Telemetry(bool tracing = false);
+    ~Telemetry();
+
+    Telemetry(const Telemetry &) = delete;
+    Telemetry &operator=(const Telemetry &) = delete;
+
+    // Runs on the reporter thread. Set before training starts.
+    void setCallback(const Callback &callback);
+
+    bool isTracing() const;
+
+    std::size_t getMaxTraceEvents() const;
+    void setMaxTraceEvents(std::size_t maxTraceEvents);
+
+    // Called by BasicNetwork::setTelemetry(). Throws std::runtime_error if
+    // another network holds it; detach() from a network that does not hold it
+    // does nothing.
+    void attach(const void *network);
+    void detach(const void *network);
+    // Set by the network for the duration of train().
+    void setTraining(bool training);
+
+    // Called by the network when it is attached and before training; allocates
+    // a ring per thread. Not safe to call while record() is running, so it
+    // asserts that train() is not.
+    void prepare(int threadCount);
+
+    // Wait-free; called from training threads. Spans from threads without a
+    // ring are counted as dropped.
+    void record(const EpochStats &stats);
+    void record(int thread, Phase phase, int epoch, Clock::time_point begin, Clock::time_point end);
+
+    // Blocks until everything recorded so far has been reported. The callback
+    // runs on the thread flush() waits for, so calling it from there deadlocks.
+    void flush();
+
+    std::vector<EpochStats> history();
+    long long droppedCount() const;
+
+    // Chrome trace event format (chrome://tracing, Perfetto); one track per
+    // training thread. Call flush() first to include the latest spans.
+    void writeTrace(const std::string &fileName);
+
+private:
+    void report();
+    void drain();
+};
@@ -1,9 +1,9 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle qt
 
-LIBS += -L../../framework/release -L../release -lframework -lneuro -lgdi32
-INCLUDEPATH += ../../framework ..
+LIBS += -L../release -lneuro
+INCLUDEPATH += ..
 
 SOURCES += \
     main.cpp
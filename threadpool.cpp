@@ -0,0 +1,81 @@
+#include "threadpool.h"
+
+int ThreadPool::hardwareConcurrency() {
+    int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+ThreadPool::ThreadPool(int size)
+    : invoke(0), task(0), generation(0), pending(0), stopping(false) {
+    for (int i = 1; i < size; i++)
+        threads.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    started.notify_all();
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+int ThreadPool::size() const {
+    return threads.size() + 1;
+}
+
+void ThreadPool::run(void (*invoke)(const void *, int), const void *task) {
+    if (threads.empty()) {
+        invoke(task, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        this->invoke = invoke;
+        this->task = task;
+        pending = threads.size();
+        generation++;
+    }
+
+    started.notify_all();
+
+    invoke(task, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return pending == 0; });
+}
+
+void ThreadPool::work(int index) {
+    long long seen = 0;
+
+    while (true) {
+        void (*invoke)(const void *, int);
+        const void *task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [this, seen]() { return stopping || generation != seen; });
+
+            if (stopping)
+                return;
+
+            seen = generation;
+            invoke = this->invoke;
+            task = this->task;
+        }
+
+        invoke(task, index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (--pending == 0)
+                finished.notify_one();
+        }
+    }
+}
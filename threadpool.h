@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Fixed-size pool that runs one task on every thread at once. Thread indices
+// are stable, so work split by index is assigned the same way on every call.
+class ThreadPool {
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable started, finished;
+
+    void (*invoke)(const void *task, int index);
+    const void *task;
+
+    long long generation;
+    int pending;
+    bool stopping;
+
+public:
+    static int hardwareConcurrency();
+
+    explicit ThreadPool(int size);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const;
+
+    // Calls task(i) for every i in [0, size()) and waits for all of them; index
+    // 0 runs on the calling thread. Dispatch does not allocate.
+    template <class F>
+    void run(const F &task);
+
+private:
+    template <class F>
+    static void call(const void *task, int index);
+
+    void run(void (*invoke)(const void *, int), const void *task);
+    void work(int index);
+};
+
+template <class F>
+void ThreadPool::run(const F &task) {
+    run(&call<F>, &task);
+}
+
+template <class F>
+void ThreadPool::call(const void *task, int index) {
+    (*static_cast<const F *>(task))(index);
+}
@@ -0,0 +1,602 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <cmath>
+#include <memory>
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <cstring>
+
+#include "network.h"
+#include "modelregistry.h"
+#include "quantizedmodel.h"
+#include "fileformat.h"
+#include "allocations.h"
+#include "datasetfile.h"
+
+// Checks the guarantees the library's documentation makes, one focused check
+// each. Prints every failure and exits with the number of failed checks.
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+}
+
+template <class T>
+T random(T low, T high) {
+    return low + (high - low) * rand() / RAND_MAX;
+}
+
+// Rows of forwardBatch() match forward() bit-for-bit, on every instruction set.
+template <class T>
+void checkForwardBatch(const char *type) {
+    for (int isa = kernels::Scalar; isa <= kernels::bestIsa(); isa++) {
+        kernels::setIsa((kernels::Isa)isa);
+
+        BasicNetwork<T> net({7, 33, 5, 3});
+        Matrix<T> inputs(67, 7);
+
+        for (int i = 0; i < inputs.height(); i++)
+            for (int j = 0; j < inputs.width(); j++)
+                inputs[i][j] = random<T>(-1, 1);
+
+        Matrix<T> outputs = net.forwardBatch(inputs);
+        bool same = true;
+
+        for (int i = 0; i < inputs.height(); i++) {
+            const std::vector<T> &output = net.forward(std::vector<T>(inputs[i], inputs[i] + inputs.width()));
+
+            for (int j = 0; j < outputs.width(); j++)
+                same = same && output[j] == outputs[i][j];
+        }
+
+        check(same, std::string("forwardBatch matches forward, ") + type + ", " + kernels::isaName((kernels::Isa)isa));
+    }
+
+    kernels::setIsa(kernels::bestIsa());
+}
+
+// After the first call, learning and inference allocate nothing. Counting
+// needs a library built with NEURO_COUNT_ALLOCATIONS (the debug build).
+void checkNoAllocations() {
+    if (allocations::count() < 0) {
+        std::cout << "skipped: steady-state allocations, counting is off in this build\n";
+        return;
+    }
+
+    for (int batchSize : {1, 10}) {
+        Network net({2, 6, 2, 2});
+        net.setBatchSize(batchSize);
+
+        std::vector<double> x = {0.5, -0.5};
+        SparseVector<double> sparse(x);
+
+        net.learn(x.data(), 1);
+        net.learn(sparse, 0);
+        net.predict(x);
+
+        long long start = allocations::count();
+
+        for (int i = 0; i < 1000; i++) {
+            net.learn(x.data(), i % 2);
+            net.learn(sparse, i % 2);
+            net.predict(x);
+            net.forward(x);
+        }
+
+        long long allocated = allocations::count() - start;
+
+        check(allocated == 0, "no allocations in steady state, batch size " + std::to_string(batchSize));
+    }
+}
+
+// The textbook form of each update rule, one weight at a time in double.
+struct Reference {
+    enum Rule {
+        Momentum,
+        Nesterov,
+        Adam,
+        RMSProp
+    };
+
+    Rule rule;
+    double beta1, beta2, epsilon;
+
+    void update(double &w, double dw, double *state, const Optimizer::Hyperparameters &h) const {
+        double g = (h.l2Decay * w + dw) / h.count;
+        double &m = state[0], &v = state[1];
+
+        switch (rule) {
+        case Momentum:
+            m = h.momentum * m - h.learningRate * g;
+            w += m;
+            break;
+
+        case Nesterov: {
+            double previous = m;
+
+            m = h.momentum * m - h.learningRate * g;
+            w += (1 + h.momentum) * m - h.momentum * previous;
+            break;
+        }
+
+        case Adam:
+            m = beta1 * m + (1 - beta1) * g;
+            v = beta2 * v + (1 - beta2) * g * g;
+            w -= h.learningRate * (m / (1 - std::pow(beta1, (double)h.step))) / (std::sqrt(v / (1 - std::pow(beta2, (double)h.step))) + epsilon);
+            break;
+
+        case RMSProp:
+            m = beta2 * m + (1 - beta2) * g * g;
+            w -= h.learningRate * g / (std::sqrt(m) + epsilon);
+            break;
+        }
+    }
+};
+
+// The fused kernels behind every optimizer follow the scalar update rule on
+// every instruction set, tail elements included, and clear the gradient.
+template <class T>
+void checkOptimizer(const char *name, const Optimizer &optimizer, const Reference &reference, double tolerance) {
+    enum { N = 37, Steps = 5 };
+
+    for (int isa = kernels::Scalar; isa <= kernels::bestIsa(); isa++) {
+        kernels::setIsa((kernels::Isa)isa);
+
+        std::vector<T> w(N), dw(N);
+        std::vector<std::vector<T>> state(Optimizer::MaxStateSize, std::vector<T>(N));
+        std::vector<double> expected(N), expectedState(2 * N);
+
+        for (int j = 0; j < N; j++)
+            expected[j] = w[j] = random<T>(-1, 1);
+
+        T *s[Optimizer::MaxStateSize];
+
+        for (int k = 0; k < Optimizer::MaxStateSize; k++)
+            s[k] = state[k].data();
+
+        bool cleared = true;
+        double error = 0;
+
+        for (int t = 1; t <= Steps; t++) {
+            Optimizer::Hyperparameters h = {0.05, 0.9, 0.01, 3, t};
+
+            for (int j = 0; j < N; j++) {
+                dw[j] = random<T>(-1, 1);
+                reference.update(expected[j], dw[j], &expectedState[2 * j], h);
+            }
+
+            optimizer.update(N, w.data(), dw.data(), s, h);
+
+            for (int j = 0; j < N; j++) {
+                cleared = cleared && dw[j] == 0;
+                error = std::max(error, std::fabs(w[j] - expected[j]) / (1 + std::fabs(expected[j])));
+            }
+        }
+
+        std::string what = std::string(name) + " update, " + (sizeof(T) == sizeof(float) ? "float" : "double") + ", " + kernels::isaName((kernels::Isa)isa);
+
+        check(error <= tolerance, what + " matches the scalar rule");
+        check(cleared, what + " clears the gradient");
+    }
+
+    kernels::setIsa(kernels::bestIsa());
+}
+
+template <class T>
+void checkOptimizers(double tolerance) {
+    checkOptimizer<T>("momentum", MomentumOptimizer(), {Reference::Momentum, 0, 0, 0}, tolerance);
+    checkOptimizer<T>("nesterov", NesterovOptimizer(), {Reference::Nesterov, 0, 0, 0}, tolerance);
+    checkOptimizer<T>("adam", AdamOptimizer(0.8, 0.95, 1e-6), {Reference::Adam, 0.8, 0.95, 1e-6}, tolerance);
+    checkOptimizer<T>("rmsprop", RMSPropOptimizer(0.85, 1e-6), {Reference::RMSProp, 0, 0.85, 1e-6}, tolerance);
+}
+
+// Row indices in the order a loader hands them out over three epochs; rows
+// are stored with their own index as the class.
+std::vector<std::vector<uint>> epochs(BasicDataLoader<double> &loader, unsigned seed, bool &rowsMatch) {
+    std::vector<std::vector<uint>> order(3);
+
+    loader.setBatchSize(7);
+    loader.setSeed(seed);
+    loader.start(order.size());
+
+    while (const BasicDataLoader<double>::Batch *batch = loader.next()) {
+        for (int k = 0; k < batch->count; k++) {
+            order[batch->epoch].push_back(batch->classIndices[k]);
+            rowsMatch = rowsMatch && batch->inputs[k] == batch->classIndices[k];
+        }
+
+        loader.release();
+    }
+
+    return order;
+}
+
+bool isPermutation(std::vector<uint> order) {
+    std::sort(order.begin(), order.end());
+
+    for (uint i = 0; i < order.size(); i++)
+        if (order[i] != i)
+            return false;
+
+    return true;
+}
+
+// A loader's epochs are permutations of the rows, different from each other
+// and reproducible for a seed, also when a file is shuffled block by block.
+void checkLoaderOrder() {
+    const char *fileName = "unit_test.ds";
+    const int N = 500;
+
+    Dataset dataset(1);
+    DatasetWriter writer(fileName, 1);
+
+    for (int i = 0; i < N; i++) {
+        float x = i;
+
+        dataset.add({x}, i);
+        writer.add(&x, i);
+    }
+
+    writer.close();
+
+    {
+        DatasetFile file(fileName);
+
+        DataLoader fromDataset(dataset), again(dataset), fromFile(file), fileAgain(file);
+        fromFile.setBlockSize(64);
+        fileAgain.setBlockSize(64);
+
+        bool rowsMatch = true;
+
+        std::vector<std::vector<uint>> a = epochs(fromDataset, 3, rowsMatch), b = epochs(again, 3, rowsMatch);
+        std::vector<std::vector<uint>> c = epochs(again, 4, rowsMatch);
+        std::vector<std::vector<uint>> d = epochs(fromFile, 3, rowsMatch), e = epochs(fileAgain, 3, rowsMatch);
+
+        bool permutations = true;
+
+        for (uint k = 0; k < a.size(); k++)
+            permutations = permutations && isPermutation(a[k]) && isPermutation(d[k]);
+
+        check(rowsMatch, "loader batches keep rows with their classes");
+        check(permutations, "loader epochs are permutations of the rows");
+        check(a[0] != a[1] && a[1] != a[2], "loader epochs are shuffled differently");
+        check(a == b && d == e, "loader order is reproducible for a seed");
+        check(a != c, "loader order depends on the seed");
+    }
+
+    std::remove(fileName);
+}
+
+// Sparse learning with lazily caught-up rows agrees with dense learning up to
+// rounding, for every optimizer and with batching.
+void checkSparseLearning() {
+    enum { Features = 40, Samples = 300 };
+
+    std::vector<std::shared_ptr<Optimizer>> optimizers = {
+        std::make_shared<MomentumOptimizer>(), std::make_shared<NesterovOptimizer>(),
+        std::make_shared<AdamOptimizer>(), std::make_shared<RMSPropOptimizer>()};
+    const char *names[] = {"momentum", "nesterov", "adam", "rmsprop"};
+
+    std::vector<std::vector<double>> inputs(Samples, std::vector<double>(Features));
+
+    for (std::vector<double> &x : inputs)
+        for (int k = 0; k < 3; k++)
+            x[rand() % Features] = random<double>(-1, 1);
+
+    std::vector<double> probe(Features);
+
+    for (double &x : probe)
+        x = random<double>(-1, 1);
+
+    for (uint o = 0; o < optimizers.size(); o++)
+        for (int batchSize : {1, 3}) {
+            Network sparse({Features, 8, 3}), dense(sparse);
+
+            for (Network *net : {&sparse, &dense}) {
+                net->setOptimizer(*optimizers[o]);
+                net->setLearningRate(0.01);
+                net->setBatchSize(batchSize);
+            }
+
+            for (int i = 0; i < Samples; i++) {
+                sparse.learn(SparseVector<double>(inputs[i]), i % 3);
+                dense.learn(inputs[i].data(), i % 3);
+            }
+
+            std::vector<double> a = sparse.forward(probe), b = dense.forward(probe);
+            double error = 0;
+
+            for (uint j = 0; j < a.size(); j++)
+                error = std::max(error, std::fabs(a[j] - b[j]));
+
+            check(error < 1e-9, std::string("sparse learning matches dense, ") + names[o] + ", batch size " + std::to_string(batchSize));
+        }
+}
+
+template <class M>
+bool isRejected(const std::string &fileName) {
+    try {
+        M::loadFromFile(fileName);
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<char> readFile(const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string &fileName, const std::vector<char> &data) {
+    std::ofstream(fileName, std::ios::binary).write(data.data(), data.size());
+}
+
+// Model files round-trip, damage anywhere in a file is caught by the checksum,
+// and well-formed files describing an impossible model are rejected.
+void checkModelFiles() {
+    const char *fileName = "unit_test.model";
+
+    Network net({5, 7, 3});
+    net.saveToFile(fileName);
+
+    std::vector<double> probe(5, 0.25);
+    std::vector<double> expected = net.forward(probe);
+
+    for (const Model &model : {Model::loadFromFile(fileName), Model::mapFile(fileName)}) {
+        Model::Workspace workspace(model);
+        check(model.forward(probe, workspace) == expected, "model files round-trip");
+    }
+
+    std::vector<char> data = readFile(fileName);
+    bool caught = true;
+
+    // A damaged magic sends the file to the legacy reader, which has to
+    // reject it too.
+    for (std::size_t i = 0; i < data.size(); i++) {
+        std::vector<char> damaged = data;
+        damaged[i] ^= 0x10;
+
+        writeFile(fileName, damaged);
+        caught = caught && isRejected<Model>(fileName);
+    }
+
+    check(caught, "a damaged byte anywhere in a model file is caught");
+
+    data.back() ^= 0x10;
+    writeFile(fileName, data);
+
+    try {
+        Model::mapFile(fileName, Model::Trust);
+    } catch (const std::runtime_error &) {
+        check(false, "mapping a trusted model file skips the checksum");
+    }
+
+    Model().saveToFile(fileName);
+    check(isRejected<Model>(fileName), "a model file without layers is rejected");
+
+    int legacy[] = {2, 3, 0};
+    std::ofstream(fileName, std::ios::binary).write((const char *)legacy, sizeof(legacy));
+    check(isRejected<Model>(fileName), "a legacy model file with an empty layer is rejected");
+
+    int huge[][3] = {{1 << 30, 3, 3}, {2, 1 << 30, 1 << 30}};
+
+    for (int *sizes : huge) {
+        std::ofstream(fileName, std::ios::binary).write((const char *)sizes, sizeof(huge[0]));
+        check(isRejected<Model>(fileName), "a legacy model file with sizes past its end is rejected");
+    }
+
+    std::remove(fileName);
+}
+
+// The same for quantized model files.
+void checkQuantizedModelFiles() {
+    const char *fileName = "unit_test.qnt";
+
+    FloatModel model = FloatNetwork({5, 7, 3}).freeze();
+    FloatDataset calibration(5);
+
+    for (int i = 0; i < 50; i++) {
+        std::vector<float> x(5);
+
+        for (float &v : x)
+            v = random<float>(-1, 1);
+
+        calibration.add(x, 0);
+    }
+
+    QuantizedModel quantized = QuantizedModel::quantize(model, calibration);
+    quantized.saveToFile(fileName);
+
+    std::vector<float> probe(5, 0.25f);
+    QuantizedModel::Workspace a, b;
+
+    check(QuantizedModel::loadFromFile(fileName).forward(probe, a) == quantized.forward(probe, b), "quantized model files round-trip");
+
+    std::vector<char> data = readFile(fileName);
+    bool caught = true;
+
+    for (std::size_t i = 0; i < data.size(); i++) {
+        std::vector<char> damaged = data;
+        damaged[i] ^= 0x10;
+
+        writeFile(fileName, damaged);
+        caught = caught && isRejected<QuantizedModel>(fileName);
+    }
+
+    check(caught, "a damaged byte anywhere in a quantized model file is caught");
+
+    QuantizedModel().saveToFile(fileName);
+    check(isRejected<QuantizedModel>(fileName), "a quantized model file without layers is rejected");
+
+    // Empties the last layer in the table after the 64-byte header and
+    // recomputes the checksum, so only the layer validation can catch it.
+    uint32_t outputs = 0;
+    uint64_t checksum = 0;
+
+    memcpy(data.data() + 64 + 24 + 4, &outputs, sizeof(outputs));
+    memcpy(data.data() + 32, &checksum, sizeof(checksum));
+
+    checksum = fileformat::checksum(data.data(), data.size());
+    memcpy(data.data() + 32, &checksum, sizeof(checksum));
+
+    writeFile(fileName, data);
+    check(isRejected<QuantizedModel>(fileName), "a quantized model file with an empty layer is rejected");
+
+    std::remove(fileName);
+}
+
+// A quantized workspace built for one model is rebuilt, not overrun, when it
+// is passed to a model with different hidden sizes.
+void checkQuantizedWorkspace() {
+    FloatDataset calibration(5);
+    calibration.add(std::vector<float>(5, 0.5f), 0);
+
+    QuantizedModel narrow = QuantizedModel::quantize(FloatNetwork({5, 7, 3}).freeze(), calibration);
+    QuantizedModel wide = QuantizedModel::quantize(FloatNetwork({5, 40, 3}).freeze(), calibration);
+
+    std::vector<float> probe(5, 0.25f);
+    QuantizedModel::Workspace shared(narrow), fresh;
+
+    narrow.forward(probe, shared);
+
+    check(wide.forward(probe, shared) == wide.forward(probe, fresh), "a quantized workspace adapts to another model");
+}
+
+bool attaches(Network &net, const std::shared_ptr<Telemetry> &telemetry) {
+    try {
+        net.setTelemetry(telemetry);
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+
+    return true;
+}
+
+// Spans from learn() outside train() land on thread 0's ring, and a telemetry
+// serves one network at a time.
+void checkTelemetry() {
+    std::shared_ptr<Telemetry> telemetry = std::make_shared<Telemetry>(true);
+
+    {
+        Network net({2, 4, 2});
+        net.setTelemetry(telemetry);
+
+        double x[] = {0.5, -0.5};
+        SparseVector<double> sparse(x, 2);
+
+        for (int i = 0; i < 10; i++) {
+            net.learn(x, 1);
+            net.learn(sparse, 0);
+        }
+
+        telemetry->flush();
+
+        check(telemetry->droppedCount() == 0, "learn() with tracing keeps its spans");
+
+        Network other({2, 4, 2});
+        check(!attaches(other, telemetry), "a telemetry attached to a network cannot be attached to another");
+    }
+
+    Network next({2, 4, 2}), last({2, 4, 2});
+
+    check(attaches(next, telemetry), "a telemetry is free again once its network is destroyed");
+
+    next.setTelemetry(std::shared_ptr<Telemetry>());
+
+    check(attaches(last, telemetry), "a telemetry is free again once its network detaches it");
+}
+
+// Readers of a registry always see a whole model while others are published,
+// and a replaced model is freed after its last reader lets go, without a
+// manual collect().
+void checkRegistrySwap() {
+    const std::vector<std::vector<int>> shapes = {{6, 9, 3}, {6, 4, 5, 2}};
+    std::vector<Model> models;
+
+    for (const std::vector<int> &sizes : shapes)
+        models.push_back(Network(sizes).freeze());
+
+    ModelRegistry registry;
+    registry.setCollectInterval(10);
+    registry.publish(models[0]);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> readers;
+
+    for (int t = 0; t < 4; t++)
+        readers.emplace_back([&]() {
+            std::vector<double> input(6, 0.5);
+
+            while (!done) {
+                std::shared_ptr<const Model> model = registry.current();
+                Model::Workspace workspace(*model);
+                std::vector<int> sizes = model->sizes();
+
+                if (std::find(shapes.begin(), shapes.end(), sizes) == shapes.end() || model->predict(input, workspace) >= (uint)sizes.back())
+                    torn++;
+            }
+        });
+
+    for (int i = 1; i <= 200; i++) {
+        registry.publish(models[i % 2]);
+        std::this_thread::yield();
+    }
+
+    done = true;
+
+    for (std::thread &reader : readers)
+        reader.join();
+
+    check(torn == 0, "registry readers see whole models during swaps");
+
+    std::shared_ptr<const Model> held = registry.current();
+    std::weak_ptr<const Model> replaced = held;
+
+    registry.publish(models[1]);
+    held.reset();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    while (!replaced.expired() && std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    check(replaced.expired(), "registry frees a replaced model without collect()");
+}
+}
+
+int main(int, const char **) {
+    srand(1);
+
+    checkForwardBatch<double>("double");
+    checkForwardBatch<float>("float");
+    checkNoAllocations();
+    checkOptimizers<double>(1e-12);
+    checkOptimizers<float>(1e-5);
+    checkLoaderOrder();
+    checkSparseLearning();
+    checkTelemetry();
+    checkModelFiles();
+    checkQuantizedModelFiles();
+    checkQuantizedWorkspace();
+    checkRegistrySwap();
+
+    if (failures == 0)
+        std::cout << "all checks passed\n";
+
+    return failures;
+}
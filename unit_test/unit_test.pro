@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += console c++11 thread
+CONFIG -= app_bundle qt
+
+LIBS += -L../release -lneuro
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp
@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += windows c++11
+CONFIG += windows c++11 thread
 QT += core gui widgets
 
 LIBS += -L../../framework/release -L../release -lframework -lneuro -lgdi32
@@ -1,13 +1,13 @@
 #include "widget.h"
 
 Widget::Widget(QWidget *parent)
-    : QWidget(parent), net(0) {
+    : QWidget(parent), trainer(0), pool(new ThreadPool(ThreadPool::hardwareConcurrency())) {
     resize(qApp->desktop()->size() / 1.5);
     setMinimumSize(qApp->desktop()->size() / 4);
 
     qsrand(QTime::currentTime().msec());
 
-    createNet();
+    createTrainer();
     init();
     defaults();
 
@@ -15,11 +15,12 @@ Widget::Widget(QWidget *parent)
 }
 
 Widget::~Widget() {
-    delete net;
+    delete trainer;
+    delete pool;
 }
 
 void Widget::timerEvent(QTimerEvent *) {
-    learn();
+    qDebug() << trainer->snapshot()->loss;
     update();
 }
 
@@ -64,12 +65,18 @@ void Widget::paintEvent(QPaintEvent *) {
 
     int radius = 5;
 
-    double step = 0.1;
+    double step = 0.05;
 
-    for (double x = -5; x < 5; x += step)
-        for (double y = -5; y < 5; y += step) {
-            uint out = net->predict({x, y});
-            p.fillRect(QRectF((x - 0.5) * scale, (0.5 - y - step) * scale, step * scale, step * scale), out == 0 ? bgRed : bgGreen);
+    Grid<double> grid = {-5, -5, step, step, 200, 200};
+    classes.resize(grid.columns * grid.rows);
+
+    std::shared_ptr<const AsyncTrainer::Snapshot> snapshot = trainer->snapshot();
+    snapshot->model.predictGrid(grid, classes.data(), pool);
+
+    for (int j = 0; j < grid.rows; j++)
+        for (int i = 0; i < grid.columns; i++) {
+            double x = grid.x0 + i * step, y = grid.y0 + j * step;
+            p.fillRect(QRectF((x - 0.5) * scale, (0.5 - y - step) * scale, step * scale, step * scale), classes[j * grid.columns + i] == 0 ? bgRed : bgGreen);
         }
 
     for (const QPair<QPointF, int> &point : points) {
@@ -82,32 +89,21 @@ void Widget::paintEvent(QPaintEvent *) {
     }
 }
 
-void Widget::createNet() {
-    net = new Network({2, 6, 2, 2});
-    net->setVerbose(false);
-
-    net->setLearningRate(0.01);
-    net->setMomentum(0.1);
-    net->setL2Decay(0.001);
-
-    net->setBatchSize(10);
-}
-
-void Widget::learn() {
-    const int n = 20;
-
-    double averageLoss = 0;
+void Widget::createTrainer() {
+    trainer = new AsyncTrainer({2, 6, 2, 2});
 
-    for (int i = 0; i < n; i++)
-        for (const QPair<QPointF, int> &point : points)
-            averageLoss += net->learn(Network::Example({point.first.x(), point.first.y()}, point.second));
+    Network &net = trainer->network();
 
-    averageLoss /= n * points.size();
+    net.setLearningRate(0.01);
+    net.setMomentum(0.1);
+    net.setL2Decay(0.001);
 
-    qDebug() << averageLoss;
+    net.setBatchSize(10);
 }
 
 void Widget::init() {
+    trainer->stop();
+
     points.clear();
 
     for (int i = 0; i < 200; i++) {
@@ -122,7 +118,13 @@ void Widget::init() {
         points << QPair<QPointF, int>((p - QPointF(0.5, 0.5)) * 10, green);
     }
 
-    net->init();
+    Dataset dataset(2);
+
+    for (const QPair<QPointF, int> &point : points)
+        dataset.add({point.first.x(), point.first.y()}, point.second);
+
+    trainer->network().init();
+    trainer->start(dataset);
 }
 
 void Widget::defaults() {
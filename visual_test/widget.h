@@ -2,13 +2,15 @@
 
 #include <QtWidgets>
 
-#include "network.h"
+#include "asynctrainer.h"
 
 class Widget : public QWidget {
     Q_OBJECT
 
-    Network *net;
+    AsyncTrainer *trainer;
+    ThreadPool *pool;
     QVector<QPair<QPointF, int>> points;
+    std::vector<uint> classes;
 
     double scale;
 
@@ -23,8 +25,7 @@ protected:
     void paintEvent(QPaintEvent *e);
 
 private:
-    void createNet();
-    void learn();
+    void createTrainer();
     void init();
     void defaults();
     void circleData();